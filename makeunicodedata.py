@@ -25,6 +25,7 @@
 # written by Fredrik Lundh (fredrik@pythonware.com)
 #
 
+import itertools
 import os
 import sys
 import zipfile
@@ -50,6 +51,10 @@ CASE_FOLDING = "CaseFolding%s.txt"
 SCRIPTS = "Scripts%s.txt"
 BIDI_MIRRORING = "BidiMirroring%s.txt"
 BIDI_BRACKETS = "BidiBrackets%s.txt"
+GRAPHEME_BREAK = "auxiliary/GraphemeBreakProperty%s.txt"
+WORD_BREAK = "auxiliary/WordBreakProperty%s.txt"
+SENTENCE_BREAK = "auxiliary/SentenceBreakProperty%s.txt"
+EMOJI_DATA = "emoji/emoji-data%s.txt"
 
 # Private Use Areas -- in planes 1, 15, 16
 PUA_1 = range(0xE000, 0xF900)
@@ -116,6 +121,19 @@ LINEBREAK_CLASSES = [ "OP", "CL", "CP", "QU", "GL", "NS", "EX", "SY",
 
 BIDI_PAIRED_BRACKET_TYPES = [ "o", "c", "n"]
 
+GRAPHEME_BREAK_NAMES = [ "Other", "CR", "LF", "Control", "Extend", "ZWJ",
+    "Regional_Indicator", "Prepend", "SpacingMark", "L", "V", "T", "LV",
+    "LVT" ]
+
+WORD_BREAK_NAMES = [ "Other", "CR", "LF", "Newline", "Extend", "ZWJ",
+    "Regional_Indicator", "Format", "Katakana", "Hebrew_Letter", "ALetter",
+    "Single_Quote", "Double_Quote", "MidNumLet", "MidLetter", "MidNum",
+    "Numeric", "ExtendNumLet", "WSegSpace" ]
+
+SENTENCE_BREAK_NAMES = [ "Other", "CR", "LF", "Extend", "Sep", "Format",
+    "Sp", "Lower", "Upper", "OLetter", "Numeric", "ATerm", "SContinue",
+    "STerm", "Close" ]
+
 # note: should match definitions in Objects/unicodectype.c
 ALPHA_MASK = 0x01
 DECIMAL_MASK = 0x02
@@ -133,7 +151,10 @@ CASE_IGNORABLE_MASK = 0x1000
 CASED_MASK = 0x2000
 EXTENDED_CASE_MASK = 0x4000
 
-def maketables(trace=0):
+def maketables(trace=0, objective=None):
+
+    if objective is None:
+        objective = SplitObjective()
 
     print("--- Reading", UNICODE_DATA % "", "...")
 
@@ -149,13 +170,13 @@ def maketables(trace=0):
         merge_old_version(version, unicode, old_unicode)
 
     #makeunicodename(unicode, trace)
-    makeunicodedata(unicode, trace)
+    makeunicodedata(unicode, trace, objective)
     #makeunicodetype(unicode, trace)
 
 # --------------------------------------------------------------------
 # unicode character properties
 
-def makeunicodedata(unicode, trace):
+def makeunicodedata(unicode, trace, objective):
 
     dummy = (CATEGORY_NAMES.index("Cn"), 0, BIDIRECTIONAL_NAMES.index("ON"),
         EASTASIANWIDTH_NAMES.index("N"), SCRIPT_NAMES.index("Unknown"),
@@ -197,6 +218,9 @@ def makeunicodedata(unicode, trace):
     decomp_prefix = [""]
     decomp_index = [0] * len(unicode.chars)
     decomp_size = 0
+    # the same records with the codepoints as UTF-32 (UCDN_UTF32_DECOMP)
+    decomp_data32 = [0]
+    decomp_index32 = [0] * len(unicode.chars)
 
     comp_pairs = []
     comp_first = [None] * len(unicode.chars)
@@ -241,37 +265,20 @@ def makeunicodedata(unicode, trace):
                     i = len(decomp_data)
                     decomp_data.extend(decomp_utf16)
                     decomp_size = decomp_size + len(decomp_utf16) * 2
+                decomp_index32[char] = len(decomp_data32)
+                decomp_data32.extend(decomp)
             else:
                 i = 0
             decomp_index[char] = i
 
     f = l = 0
-    comp_first_ranges = []
-    comp_last_ranges = []
-    prev_f = prev_l = None
     for i in unicode.chars:
         if comp_first[i] is not None:
             comp_first[i] = f
             f += 1
-            if prev_f is None:
-                prev_f = (i,i)
-            elif prev_f[1]+1 == i:
-                prev_f = prev_f[0],i
-            else:
-                comp_first_ranges.append(prev_f)
-                prev_f = (i,i)
         if comp_last[i] is not None:
             comp_last[i] = l
             l += 1
-            if prev_l is None:
-                prev_l = (i,i)
-            elif prev_l[1]+1 == i:
-                prev_l = prev_l[0],i
-            else:
-                comp_last_ranges.append(prev_l)
-                prev_l = (i,i)
-    comp_first_ranges.append(prev_f)
-    comp_last_ranges.append(prev_l)
     total_first = f
     total_last = l
 
@@ -297,11 +304,52 @@ def makeunicodedata(unicode, trace):
     print("/* this file was generated by %s %s */" % (SCRIPT, VERSION), file=fp)
     print(file=fp)
     print('#define UNIDATA_VERSION "%s"' % UNIDATA_VERSION, file=fp)
+    print("#ifdef UCDN_PACKED_RECORDS", file=fp)
+    # Records packed into 32 bits, lowest bits first: category, bidi
+    # class, linebreak class, index of the combining class and, as they
+    # would need one bit too many otherwise, script and east asian width
+    # combined into script * number of widths + width.
+    combining_values = sorted(set(item[1] for item in table))
+    widths = len(EASTASIANWIDTH_NAMES)
+    fields = [("CATEGORY", max(item[0] for item in table)),
+              ("BIDI", max(item[2] for item in table)),
+              ("LINEBREAK", max(item[5] for item in table)),
+              ("COMBINING", len(combining_values) - 1),
+              ("SCRIPT_WIDTH", max(item[4] for item in table) * widths +
+                               widths - 1)]
+    print("/* combining classes occurring in the database */", file=fp)
+    Array("combining_values", combining_values).dump(fp, trace)
+    print("/* a list of unique database records, packed */", file=fp)
+    shift = 0
+    shifts = {}
+    for name, maxval in fields:
+        bits = maxval.bit_length()
+        shifts[name] = shift
+        print("#define PACKED_%s_SHIFT %d" % (name, shift), file=fp)
+        print("#define PACKED_%s_MASK 0x%x" % (name, (1 << bits) - 1),
+              file=fp)
+        shift += bits
+    assert shift <= 32, "packed records need %d bits" % shift
+    print("#define PACKED_WIDTHS %d" % widths, file=fp)
+    packed = []
+    for item in table:
+        packed.append(item[0] << shifts["CATEGORY"] |
+                      item[2] << shifts["BIDI"] |
+                      item[5] << shifts["LINEBREAK"] |
+                      combining_values.index(item[1]) << shifts["COMBINING"] |
+                      (item[4] * widths + item[3]) << shifts["SCRIPT_WIDTH"])
+    print("static const UCDRecord ucd_records[] = {", file=fp)
+    for i in range(0, len(packed), 6):
+        print("   " + "".join(" 0x%08x," % v for v in packed[i:i+6]),
+              file=fp)
+    print("};", file=fp)
+    print("#else", file=fp)
     print("/* a list of unique database records */", file=fp)
     print("static const UCDRecord ucd_records[] = {", file=fp)
     for item in table:
         print("    {%d, %d, %d, %d, %d, %d}," % item, file=fp)
     print("};", file=fp)
+    print("#endif", file=fp)
     print(file=fp)
 
     print("#define BIDI_MIRROR_LEN %d" % len(unicode.bidi_mirroring), file=fp)
@@ -311,6 +359,19 @@ def makeunicodedata(unicode, trace):
     print("};", file=fp)
     print(file=fp)
 
+    # trie of 1-based indices into mirror_pairs, 0 if not mirrored
+    mirror_index = [0] * 0x10000
+    for i, (char, mirror) in enumerate(unicode.bidi_mirroring):
+        assert char < 0x10000 and mirror < 0x10000
+        mirror_index[char] = i + 1
+    index0, index1, index2, shift1, shift2 = get_best_split(mirror_index)
+    print("/* index tables for the mirror pairs of the BMP */", file=fp)
+    print("#define MIRROR_SHIFT1", shift1, file=fp)
+    print("#define MIRROR_SHIFT2", shift2, file=fp)
+    Array("mirror_index0", index0).dump(fp, trace)
+    Array("mirror_index1", index1).dump(fp, trace)
+    Array("mirror_index2", index2).dump(fp, trace)
+
     print("#define BIDI_BRACKET_LEN %d" % len(unicode.bidi_brackets), file=fp)
     print("static const BracketPair bracket_pairs[] = {", file=fp)
     for triple in unicode.bidi_brackets:
@@ -318,19 +379,175 @@ def makeunicodedata(unicode, trace):
     print("};", file=fp)
     print(file=fp)
 
-    print("/* Reindexing of NFC first characters. */", file=fp)
+    # trie of 1-based indices into bracket_pairs, 0 if not a bracket
+    bracket_index = [0] * 0x10000
+    for i, (char, pair, type) in enumerate(unicode.bidi_brackets):
+        assert char < 0x10000 and pair < 0x10000
+        bracket_index[char] = i + 1
+    index0, index1, index2, shift1, shift2 = get_best_split(bracket_index)
+    print("/* index tables for the bracket pairs of the BMP */", file=fp)
+    print("#define BRACKET_SHIFT1", shift1, file=fp)
+    print("#define BRACKET_SHIFT2", shift2, file=fp)
+    Array("bracket_index0", index0).dump(fp, trace)
+    Array("bracket_index1", index1).dump(fp, trace)
+    Array("bracket_index2", index2).dump(fp, trace)
+
+    # trie of the reindexed NFC first and last characters, both stored
+    # 1-based in one entry so that a pair is looked up with two loads
+    # each, 0 if the character does not take part in any composition
+    last_shift = total_first.bit_length()
+    nfc_index = [0] * len(unicode.chars)
+    for i in unicode.chars:
+        if comp_first[i] is not None:
+            nfc_index[i] |= comp_first[i] + 1
+        if comp_last[i] is not None:
+            nfc_index[i] |= (comp_last[i] + 1) << last_shift
+    index0, index1, index2, shift1, shift2 = get_best_split(nfc_index)
+    print("/* Reindexing of NFC first and last characters. */", file=fp)
     print("#define TOTAL_FIRST",total_first, file=fp)
     print("#define TOTAL_LAST",total_last, file=fp)
-    print("static const Reindex nfc_first[] = {", file=fp)
-    for start,end in comp_first_ranges:
-        print("  { %d, %d, %d}," % (start,end-start,comp_first[start]), file=fp)
-    print("  {0,0,0}", file=fp)
-    print("};\n", file=fp)
-    print("static const Reindex nfc_last[] = {", file=fp)
-    for start,end in comp_last_ranges:
-        print("  { %d, %d, %d}," % (start,end-start,comp_last[start]), file=fp)
-    print("  {0,0,0}", file=fp)
-    print("};\n", file=fp)
+    print("#define NFC_LAST_SHIFT", last_shift, file=fp)
+    print("#define NFC_SHIFT1", shift1, file=fp)
+    print("#define NFC_SHIFT2", shift2, file=fp)
+    Array("nfc_index0", index0).dump(fp, trace)
+    Array("nfc_index1", index1).dump(fp, trace)
+    Array("nfc_index2", index2).dump(fp, trace)
+
+    # trie of the normalization quick check properties, two bits per form
+    # in the order NFD, NFKD, NFC, NFKC (0 yes, 1 maybe, 2 no), with the
+    # canonical combining class above them
+    qc_index = [0] * len(unicode.chars)
+    for char in unicode.chars:
+        record = unicode.table[char]
+        if record:
+            qc_index[char] = record[17] | int(record[3]) << 8
+    index0, index1, index2, shift1, shift2 = get_best_split(qc_index)
+    print("/* index tables for the normalization quick checks */", file=fp)
+    print("#define QC_SHIFT1", shift1, file=fp)
+    print("#define QC_SHIFT2", shift2, file=fp)
+    Array("qc_index0", index0).dump(fp, trace)
+    Array("qc_index1", index1).dump(fp, trace)
+    Array("qc_index2", index2).dump(fp, trace)
+
+    # case mappings: unique records of the simple mappings and the simple
+    # case folding as deltas, the Cased and Case_Ignorable properties and
+    # the offset of the full mappings in case_special, 0 if they are the
+    # simple ones. The full mappings are a header (lengths of the lower,
+    # title, upper mapping and the case folding, 4 bits each) followed by
+    # the codepoints.
+    case_special = [0]
+    case_records = [(0, 0, 0, 0, 0, 0)]
+    case_cache = {case_records[0]: 0}
+    case_index = [0] * len(unicode.chars)
+    for char in unicode.chars:
+        record = unicode.table[char]
+        if record:
+            upper = int(record[12] or "%x" % char, 16) - char
+            lower = int(record[13] or "%x" % char, 16) - char
+            title = int(record[14], 16) - char if record[14] else upper
+            fold = unicode.case_folding_simple.get(char, char)
+            fold_full = unicode.case_folding.get(char, [fold])
+            flags = (("Cased" in record[16]) |
+                     ("Case_Ignorable" in record[16]) << 1)
+            special = 0
+            if char in unicode.special_casing or fold_full != [fold]:
+                lower_full, title_full, upper_full = \
+                    unicode.special_casing.get(char, ([char + lower],
+                        [char + title], [char + upper]))
+                special = len(case_special)
+                case_special.append(len(lower_full) |
+                                    len(title_full) << 4 |
+                                    len(upper_full) << 8 |
+                                    len(fold_full) << 12)
+                case_special.extend(lower_full + title_full + upper_full +
+                                    fold_full)
+            item = (lower, upper, title, fold - char, flags, special)
+            i = case_cache.get(item)
+            if i is None:
+                case_cache[item] = i = len(case_records)
+                case_records.append(item)
+            case_index[char] = i
+    print(len(case_records), "unique case records,",
+          len(case_special), "full case mapping entries")
+
+    print("/* a list of unique case mapping records */", file=fp)
+    print("static const CaseRecord case_records[] = {", file=fp)
+    for item in case_records:
+        print("    {%d, %d, %d, %d, %d, %d}," % item, file=fp)
+    print("};", file=fp)
+    print(file=fp)
+    print("/* full case mappings of SpecialCasing.txt */", file=fp)
+    Array("case_special", case_special).dump(fp, trace)
+    index0, index1, index2, shift1, shift2 = get_best_split(case_index)
+    print("/* index tables for the case mapping records */", file=fp)
+    print("#define CASE_SHIFT1", shift1, file=fp)
+    print("#define CASE_SHIFT2", shift2, file=fp)
+    Array("case_index0", index0).dump(fp, trace)
+    Array("case_index1", index1).dump(fp, trace)
+    Array("case_index2", index2).dump(fp, trace)
+
+    # NFKC_Casefold mappings as UTF-32 with the length in the top byte of
+    # the first codepoint (a lone 0 for an empty mapping), 0 is the
+    # codepoint itself
+    nfkc_cf_data = [0]
+    nfkc_cf_cache = {}
+    nfkc_cf_index = [0] * len(unicode.chars)
+    for char, mapping in sorted(unicode.nfkc_casefold.items()):
+        if mapping == [char]:
+            continue
+        mapping = tuple(mapping)
+        i = nfkc_cf_cache.get(mapping)
+        if i is None:
+            nfkc_cf_cache[mapping] = i = len(nfkc_cf_data)
+            if mapping:
+                nfkc_cf_data.append(mapping[0] | len(mapping) << 24)
+                nfkc_cf_data.extend(mapping[1:])
+            else:
+                nfkc_cf_data.append(0)
+        nfkc_cf_index[char] = i
+    nfkc_cf_max = max(len(mapping) for mapping in nfkc_cf_cache)
+    print(len(nfkc_cf_cache), "unique NFKC_Casefold mappings,",
+          "at most", nfkc_cf_max, "codepoints")
+
+    index0, index1, index2, shift1, shift2 = get_best_split(nfkc_cf_index)
+    print("/* NFKC_Casefold mappings */", file=fp)
+    print("#define NFKC_CF_MAX", nfkc_cf_max, file=fp)
+    Array("nfkc_cf_data", nfkc_cf_data).dump(fp, trace)
+    print("/* index tables for the NFKC_Casefold mappings */", file=fp)
+    print("#define NFKC_CF_SHIFT1", shift1, file=fp)
+    print("#define NFKC_CF_SHIFT2", shift2, file=fp)
+    Array("nfkc_cf_index0", index0).dump(fp, trace)
+    Array("nfkc_cf_index1", index1).dump(fp, trace)
+    Array("nfkc_cf_index2", index2).dump(fp, trace)
+
+    # text segmentation: records of the Grapheme_Cluster_Break property
+    # in bits 0-3, Extended_Pictographic in bit 4, Word_Break in bits 5-9
+    # and Sentence_Break in bits 10-13
+    segment_records = [0]
+    segment_cache = {0: 0}
+    segment = [0] * len(unicode.chars)
+    for char in unicode.chars:
+        record = (GRAPHEME_BREAK_NAMES.index(unicode.grapheme_break[char]) |
+                  (char in unicode.extended_pictographic) << 4 |
+                  WORD_BREAK_NAMES.index(unicode.word_break[char]) << 5 |
+                  SENTENCE_BREAK_NAMES.index(
+                      unicode.sentence_break[char]) << 10)
+        if record not in segment_cache:
+            segment_cache[record] = len(segment_records)
+            segment_records.append(record)
+        segment[char] = segment_cache[record]
+
+    print(len(segment_records), "unique segmentation records")
+    Array("segment_records", segment_records).dump(fp, trace)
+
+    index0, index1, index2, shift1, shift2 = get_best_split(segment)
+    print("/* index tables for the text segmentation records */",
+          file=fp)
+    print("#define SEGMENT_SHIFT1", shift1, file=fp)
+    print("#define SEGMENT_SHIFT2", shift2, file=fp)
+    Array("segment_index0", index0).dump(fp, trace)
+    Array("segment_index1", index1).dump(fp, trace)
+    Array("segment_index2", index2).dump(fp, trace)
 
     # FIXME: <fl> the following tables could be made static, and
     # the support code moved into unicodedatabase.c
@@ -386,24 +603,105 @@ def makeunicodedata(unicode, trace):
     print("};", file=fp)
     """
 
-    index0, index1, index2, shift1, shift2 = get_best_split(index)
+    # Two layouts of the record index are written, selected at build time:
+    # a three-stage trie for all codepoints plus a direct index for
+    # Latin-1 (the default, compact one), or a direct index for the BMP
+    # plus a trie for the supplementary planes only (UCDN_FLAT_BMP).
+    # The shape of the tries is chosen by the given objective.
+    print("#ifdef UCDN_FLAT_BMP", file=fp)
+    print("/* direct index of the database records for the BMP */", file=fp)
+    Array("bmp_index", index[:0x10000] + [0]).dump(fp, trace)
+
+    stages, shifts = get_tuned_split(index[0x10000:0x110000], objective,
+                                     0x10000)
+    print("/* index tables for the records of the supplementary planes */",
+          file=fp)
+    print("#define TRIE_BASE 0x10000", file=fp)
+    dump_trie(fp, trace, stages, shifts)
+    print("#else", file=fp)
+
+    stages, shifts = get_tuned_split(index, objective)
     print("/* index tables for the database records */", file=fp)
-    print("#define SHIFT1", shift1, file=fp)
-    print("#define SHIFT2", shift2, file=fp)
-    Array("index0", index0).dump(fp, trace)
-    Array("index1", index1).dump(fp, trace)
-    Array("index2", index2).dump(fp, trace)
+    print("#define TRIE_BASE 0", file=fp)
+    dump_trie(fp, trace, stages, shifts)
 
-    index0, index1, index2, shift1, shift2 = get_best_split(decomp_index)
-    print("/* decomposition data */", file=fp)
-    Array("decomp_data", decomp_data).dump(fp, trace)
+    print("/* direct index of the database records for Latin-1 */", file=fp)
+    Array("latin1_index", index[:256] + [0] * 3).dump(fp, trace)
+    print("#endif", file=fp)
+    print(file=fp)
 
-    print("/* index tables for the decomposition data */", file=fp)
-    print("#define DECOMP_SHIFT1", shift1, file=fp)
-    print("#define DECOMP_SHIFT2", shift2, file=fp)
-    Array("decomp_index0", index0).dump(fp, trace)
-    Array("decomp_index1", index1).dump(fp, trace)
-    Array("decomp_index2", index2).dump(fp, trace)
+    # Tries holding the value of a single property directly, for the hot
+    # single-property getters (UCDN_PROPERTY_TRIES). There are far fewer
+    # distinct values than records, so the leaf blocks dedup better.
+    print("#ifdef UCDN_PROPERTY_TRIES", file=fp)
+    for name, field in (("script", 4), ("bidi", 2), ("linebreak", 5)):
+        values = [table[i][field] for i in index]
+        index0, index1, index2, shift1, shift2 = get_best_split(values)
+        print("/* index tables for the %s property */" % name, file=fp)
+        print("#define %s_SHIFT1" % name.upper(), shift1, file=fp)
+        print("#define %s_SHIFT2" % name.upper(), shift2, file=fp)
+        Array("%s_index0" % name, index0).dump(fp, trace)
+        Array("%s_index1" % name, index1).dump(fp, trace)
+        Array("%s_index2" % name, index2).dump(fp, trace)
+    print("#endif", file=fp)
+    print(file=fp)
+
+    # Decomposition records are a header (prefix | length << 8) followed
+    # by the codepoints, either as UTF-16 (the default, compact one) or
+    # as UTF-32, which can be copied out directly (UCDN_UTF32_DECOMP).
+    for utf32, data, index in ((1, decomp_data32, decomp_index32),
+                               (0, decomp_data, decomp_index)):
+        print("#ifdef UCDN_UTF32_DECOMP" if utf32 else "#else", file=fp)
+        index0, index1, index2, shift1, shift2 = get_best_split(index)
+        print("/* decomposition data, %s */" % ("UTF-32" if utf32
+                                                 else "UTF-16"), file=fp)
+        Array("decomp_data", data).dump(fp, trace)
+
+        print("/* index tables for the decomposition data */", file=fp)
+        print("#define DECOMP_SHIFT1", shift1, file=fp)
+        print("#define DECOMP_SHIFT2", shift2, file=fp)
+        Array("decomp_index0", index0).dump(fp, trace)
+        Array("decomp_index1", index1).dump(fp, trace)
+        Array("decomp_index2", index2).dump(fp, trace)
+    print("#endif", file=fp)
+
+    # fully expanded canonical decompositions, as UTF-32 with the length
+    # in the top byte of the first codepoint, 0 is no decomposition.
+    # Hangul syllables are decomposed algorithmically and not included.
+    def full_canonical(char):
+        record = unicode.table[char]
+        if record and record[5] and record[5][0] != "<":
+            return sum((full_canonical(int(c, 16))
+                        for c in record[5].split()), [])
+        return [char]
+
+    full_data = [0]
+    full_cache = {}
+    full_index = [0] * len(unicode.chars)
+    for char in unicode.chars:
+        record = unicode.table[char]
+        if record and record[5] and record[5][0] != "<":
+            full = tuple(full_canonical(char))
+            i = full_cache.get(full)
+            if i is None:
+                full_cache[full] = i = len(full_data)
+                full_data.append(full[0] | len(full) << 24)
+                full_data.extend(full[1:])
+            full_index[char] = i
+    full_max = max(len(full) for full in full_cache)
+    print(len(full_cache), "unique full canonical decompositions,",
+          "at most", full_max, "codepoints")
+
+    index0, index1, index2, shift1, shift2 = get_best_split(full_index)
+    print("/* fully expanded canonical decompositions */", file=fp)
+    print("#define FULL_DECOMP_MAX", full_max, file=fp)
+    Array("full_decomp_data", full_data).dump(fp, trace)
+    print("/* index tables for the full canonical decompositions */", file=fp)
+    print("#define FULL_DECOMP_SHIFT1", shift1, file=fp)
+    print("#define FULL_DECOMP_SHIFT2", shift2, file=fp)
+    Array("full_decomp_index0", index0).dump(fp, trace)
+    Array("full_decomp_index1", index1).dump(fp, trace)
+    Array("full_decomp_index2", index2).dump(fp, trace)
 
     index0, index1, index2, shift1, shift2 = get_best_split(comp_data)
     print("/* NFC pairs */", file=fp)
@@ -963,6 +1261,8 @@ def open_data(template, version):
             url = 'http://www.unicode.org/Public/3.2-Update/' + local
         else:
             url = ('http://www.unicode.org/Public/%s/ucd/'+template) % (version, '')
+        if os.path.dirname(local):
+            os.makedirs(os.path.dirname(local), exist_ok=True)
         urllib.request.urlretrieve(url, filename=local)
     if local.endswith('.txt'):
         return open(local, encoding='utf-8')
@@ -1155,11 +1455,22 @@ class UnicodeData:
         # for older versions, and no delta records will be created.
         quickchecks = [0] * 0x110000
         qc_order = 'NFD_QC NFKD_QC NFC_QC NFKC_QC'.split()
+        # NFKC_Casefold mappings, possibly empty, also for unassigned
+        # default ignorable code points
+        nfkc_cf = self.nfkc_casefold = {}
         with open_data(DERIVEDNORMALIZATION_PROPS, version) as file:
             for s in file:
                 if '#' in s:
                     s = s[:s.index('#')]
                 s = [i.strip() for i in s.split(';')]
+                if len(s) > 2 and s[1] == 'NFKC_CF':
+                    if '..' not in s[0]:
+                        first = last = int(s[0], 16)
+                    else:
+                        first, last = [int(c, 16) for c in s[0].split('..')]
+                    for char in range(first, last+1):
+                        nfkc_cf[char] = [int(c, 16) for c in s[2].split()]
+                    continue
                 if len(s) < 2 or s[1] not in qc_order:
                     continue
                 quickcheck = 'MN'.index(s[2]) + 1 # Maybe or No
@@ -1246,6 +1557,7 @@ class UnicodeData:
                 upper = [int(char, 16) for char in data[3].split()]
                 sc[c] = (lower, title, upper)
         cf = self.case_folding = {}
+        cf_simple = self.case_folding_simple = {}
         if version != '3.2.0':
             with open_data(CASE_FOLDING, version) as file:
                 for s in file:
@@ -1253,9 +1565,11 @@ class UnicodeData:
                     if not s:
                         continue
                     data = s.split("; ")
+                    c = int(data[0], 16)
                     if data[1] in "CF":
-                        c = int(data[0], 16)
                         cf[c] = [int(char, 16) for char in data[2].split()]
+                    if data[1] in "CS":
+                        cf_simple[c] = int(data[2], 16)
 
         with open_data(BIDI_MIRRORING, version) as file:
             for s in file:
@@ -1272,6 +1586,40 @@ class UnicodeData:
                     continue
                 bidi_brackets.append((int(s[0], 16), int(s[1], 16), BIDI_PAIRED_BRACKET_TYPES.index(s[2])))
 
+        # text segmentation properties, which also cover unassigned
+        # codepoints
+        for attr, template, names in [
+                ("grapheme_break", GRAPHEME_BREAK, GRAPHEME_BREAK_NAMES),
+                ("word_break", WORD_BREAK, WORD_BREAK_NAMES),
+                ("sentence_break", SENTENCE_BREAK, SENTENCE_BREAK_NAMES)]:
+            values = ["Other"] * 0x110000
+            setattr(self, attr, values)
+            with open_data(template, version) as file:
+                for s in file:
+                    s = s.partition('#')[0]
+                    s = [i.strip() for i in s.split(';')]
+                    if len(s) < 2 or s[1] not in names:
+                        continue
+                    if '..' not in s[0]:
+                        first = last = int(s[0], 16)
+                    else:
+                        first, last = [int(c, 16) for c in s[0].split('..')]
+                    for char in range(first, last+1):
+                        values[char] = s[1]
+
+        ep = self.extended_pictographic = set()
+        with open_data(EMOJI_DATA, version) as file:
+            for s in file:
+                s = s.partition('#')[0]
+                s = [i.strip() for i in s.split(';')]
+                if len(s) < 2 or s[1] != "Extended_Pictographic":
+                    continue
+                if '..' not in s[0]:
+                    first = last = int(s[0], 16)
+                else:
+                    first, last = [int(c, 16) for c in s[0].split('..')]
+                ep.update(range(first, last+1))
+
     def uselatin1(self):
         # restrict character range to ISO Latin 1
         self.chars = list(range(256))
@@ -1467,31 +1815,36 @@ def splitbins(t, trace=0):
             assert t[i] == t2[(t1[i >> shift] << shift) + (i & mask)]
     return best
 
-def split3(tab, size1, size2):
-    blocks1 = {} # dict for block search (stage 1)
-    blocks2 = {} # dict for block search (stage 2)
-    stage0 = [] # contains block numbers (indices into stage 1 table)
-    stage1 = [] # contains block numbers (indices into stage 2 table)
-    stage2 = [] # contains actual data
-
-    # add blocks to stage2 and generate temporary stage1
-    stage1_tmp = []
-    for i in range(0, len(tab), size2):
-        block = tab[i:i+size2]
-        if not tuple(block) in blocks2:
-            blocks2[tuple(block)] = len(stage2) // size2;
-            stage2 += block;
-        stage1_tmp.append(blocks2[tuple(block)])
-
-    # add blocks to stage1 and generate stage0
-    for i in range(0, len(stage1_tmp), size1):
-        block = stage1_tmp[i:i+size1]
-        if not tuple(block) in blocks1:
-            blocks1[tuple(block)] = len(stage1) // size1;
-            stage1 += block;
-        stage0.append(blocks1[tuple(block)])
-
-    return stage0, stage1, stage2
+def split_blocks(tab, size):
+    """Split tab into blocks of size entries and remove duplicate blocks.
+    Returns the block numbers for tab and the unique blocks."""
+    blocks = {} # dict for block search
+    index = [] # contains block numbers (indices into stage)
+    stage = [] # contains unique blocks
+    for i in range(0, len(tab), size):
+        block = tuple(tab[i:i+size])
+        if not block in blocks:
+            blocks[block] = len(stage) // size
+            stage += block
+        index.append(blocks[block])
+    return index, stage
+
+def splitn(tab, shifts, cache=None):
+    """Split tab into a multi-stage table with the given block shifts, top
+    stage first. Each stage holds block numbers into the next stage and
+    the last one holds the actual data. Intermediate results are memoized
+    in the optional cache dict, keyed on the trailing shifts."""
+    if not shifts:
+        return [list(tab)]
+    key = tuple(shifts)
+    if cache is not None and key in cache:
+        return cache[key]
+    upper = splitn(tab, shifts[1:], cache)
+    index, stage = split_blocks(upper[0], 2**shifts[0])
+    stages = [index, stage] + upper[1:]
+    if cache is not None:
+        cache[key] = stages
+    return stages
 
 def get_type(seq):
     type_size = [("uint8_t", 1), ("uint16_t", 2), ("uint32_t", 4),
@@ -1508,9 +1861,10 @@ def get_best_split(tab):
     best_block_sizes = (1, 1)
     best_size = 2**32
     best_split = None
+    cache = {}
     for s1 in range(1, 9):
         for s2 in range(1, 9):
-            stages = split3(tab, 2**s1, 2**s2)
+            stages = splitn(tab, [s1, s2], cache)
             types = [get_type(x) for x in stages]
             sizes = [len(s) * t[1] for s, t in zip(stages, types)]
             if sum(sizes) < best_size:
@@ -1518,7 +1872,102 @@ def get_best_split(tab):
                 best_block_sizes = s1, s2
                 best_split = stages
     print("best", best_block_sizes)
-    return best_split + best_block_sizes
+    return tuple(best_split) + best_block_sizes
+
+class SplitObjective:
+    """Cost model for choosing the layout of the property trie.
+
+    kind is one of
+      "size"  - total size of the tables in bytes,
+      "cache" - number of cache lines of the tables touched when looking
+                up the codepoints of the profile, i.e. the working set
+                that has to stay in L1/L2,
+      "mixed" - weight * size in cache lines + (1 - weight) * lines
+                touched.
+    The profile maps codepoints to their frequency. With coverage < 1,
+    the rarest codepoints accounting for the remaining share of lookups
+    are ignored for the working set. Ties are broken by fewer stages,
+    then by smaller size.
+    """
+
+    def __init__(self, kind="size", profile=None, weight=0.5,
+                 coverage=1.0, stages=(2, 3, 4), line_size=64):
+        if kind != "size" and not profile:
+            raise ValueError("objective %s needs a profile" % kind)
+        self.kind = kind
+        self.weight = weight
+        self.stages = stages
+        self.line_size = line_size
+        self.hot = []
+        if profile:
+            total = sum(profile.values())
+            seen = 0
+            for code, count in sorted(profile.items(),
+                                      key=lambda item: (-item[1], item[0])):
+                if seen >= coverage * total:
+                    break
+                self.hot.append(code)
+                seen += count
+
+    def lines_touched(self, stages, shifts, sizes, base):
+        lines = set()
+        for code in self.hot:
+            if code < base or code >= 0x110000:
+                continue
+            code -= base
+            low = sum(shifts)
+            pos = code >> low
+            for n in range(len(stages)):
+                lines.add((n, pos * sizes[n] // self.line_size))
+                if n + 1 < len(stages):
+                    low -= shifts[n]
+                    pos = (stages[n][pos] << shifts[n]) + \
+                        ((code >> low) & ((1 << shifts[n]) - 1))
+        return len(lines)
+
+    def cost(self, stages, shifts, base=0):
+        sizes = [getsize(stage) for stage in stages]
+        size = sum(len(stage) * s for stage, s in zip(stages, sizes))
+        if self.kind == "size":
+            main = size
+        else:
+            lines = self.lines_touched(stages, shifts, sizes, base)
+            if self.kind == "cache":
+                main = lines
+            else:
+                main = self.weight * size / self.line_size + \
+                    (1 - self.weight) * lines
+        return main, len(stages), size
+
+def get_tuned_split(tab, objective, base=0):
+    """Find the best multi-stage split of tab according to objective.
+    base is the codepoint of tab[0]. Returns the stages, top stage first,
+    and the block shifts."""
+    best = None
+    cache = {}
+    maxshift = (len(tab) - 1).bit_length()
+    for n in objective.stages:
+        ranges = [range(1, 17)] if n == 2 else [range(1, 9)] * (n - 1)
+        for shifts in itertools.product(*ranges):
+            # the blocks of the top stage have to divide the table evenly
+            if sum(shifts) > maxshift or len(tab) % 2**sum(shifts):
+                continue
+            stages = splitn(tab, list(shifts), cache)
+            cost = objective.cost(stages, shifts, base)
+            if best is None or cost < best[0]:
+                best = cost, stages, list(shifts)
+    cost, stages, shifts = best
+    print("best", tuple(shifts), "cost", cost)
+    return stages, shifts
+
+def dump_trie(fp, trace, stages, shifts):
+    print("#define TRIE_STAGES", len(stages), file=fp)
+    for n, shift in enumerate(shifts):
+        print("#define SHIFT%d" % (n + 1), shift, file=fp)
+    # pad the tables so that every entry can be fetched with a 32-bit
+    # gather load without reading past the end of the array
+    for n, stage in enumerate(stages):
+        Array("index%d" % n, stage + [0] * 3).dump(fp, trace)
 
 def encode_utf16_surrogates(code):
     assert(code < 0x110000)
@@ -1529,5 +1978,65 @@ def encode_utf16_surrogates(code):
     low_sur = 0xdc00 + low
     return high_sur, low_sur
 
+def read_profile(profile, filename):
+    """Add a codepoint histogram to profile. Each line holds a codepoint
+    or a range of codepoints (hex, like in the UCD files) and optionally
+    a count, which defaults to 1; # starts a comment."""
+    with open(filename) as f:
+        for line in f:
+            fields = line.split("#", 1)[0].split()
+            if not fields:
+                continue
+            first, _, last = fields[0].upper().replace("U+", "").partition("..")
+            count = int(fields[1]) if len(fields) > 1 else 1
+            for code in range(int(first, 16), int(last or first, 16) + 1):
+                profile[code] = profile.get(code, 0) + count
+
+def read_profile_text(profile, filename):
+    """Add the codepoints of a UTF-8 sample text to profile."""
+    with open(filename, encoding="utf-8", errors="replace") as f:
+        for char in f.read():
+            profile[ord(char)] = profile.get(ord(char), 0) + 1
+
 if __name__ == "__main__":
-    maketables(1)
+    import argparse
+
+    parser = argparse.ArgumentParser(
+        description="Generate ucdn_db.h from the Unicode database files.")
+    parser.add_argument("--objective", choices=["size", "cache", "mixed"],
+        default="size", help="what the layout of the property trie is "
+        "optimized for (default: size)")
+    parser.add_argument("--profile", action="append", default=[],
+        metavar="FILE", help="codepoint histogram: lines of a codepoint or "
+        "range and an optional count")
+    parser.add_argument("--profile-text", action="append", default=[],
+        metavar="FILE", help="UTF-8 sample text to build the histogram from")
+    parser.add_argument("--weight", type=float, default=0.5,
+        help="weight of the size for the mixed objective (default: 0.5)")
+    parser.add_argument("--coverage", type=float, default=1.0,
+        help="share of lookups in the profile the working set has to "
+        "cover (default: 1.0)")
+    parser.add_argument("--stages",
+        help="comma-separated number of trie stages to consider (default: "
+        "3 for the size objective, which keeps the usual layout, 2,3,4 "
+        "otherwise)")
+    args = parser.parse_args()
+
+    profile = {}
+    for filename in args.profile:
+        read_profile(profile, filename)
+    for filename in args.profile_text:
+        read_profile_text(profile, filename)
+
+    if args.stages is None:
+        args.stages = "3" if args.objective == "size" else "2,3,4"
+    stages = tuple(int(n) for n in args.stages.split(","))
+    if not set(stages) <= {2, 3, 4}:
+        parser.error("only 2, 3 or 4 stages are supported")
+    try:
+        objective = SplitObjective(args.objective, profile, args.weight,
+                                   args.coverage, stages)
+    except ValueError as e:
+        parser.error(str(e))
+
+    maketables(1, objective)
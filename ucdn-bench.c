@@ -0,0 +1,752 @@
+/*
+ * Copyright (C) 2012 Grigori Goronzy <greg@kinoho.net>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "ucdn.h"
+
+#define CORPUS_LEN (4 * 1024 * 1024)
+#define STREAM_CHUNK 4096
+
+typedef struct {
+    uint32_t first, last;
+    int weight;
+} ScriptRange;
+
+typedef struct {
+    const char *name;
+    const ScriptRange *scripts;
+    int len;
+} Corpus;
+
+/*
+ * Letters of a few common scripts, weighted roughly according to their
+ * share in a multilingual web corpus.
+ */
+static const ScriptRange mixed_scripts[] = {
+    {   0x0061,  0x007a, 40 }, /* Latin */
+    {   0x00e0,  0x00ff,  4 }, /* Latin-1 */
+    {   0x0430,  0x044f, 10 }, /* Cyrillic */
+    {   0x03b1,  0x03c9,  3 }, /* Greek */
+    {   0x0627,  0x064a,  6 }, /* Arabic */
+    {   0x05d0,  0x05ea,  2 }, /* Hebrew */
+    {   0x0915,  0x0939,  4 }, /* Devanagari */
+    {   0x4e00,  0x9fa5, 14 }, /* Han */
+    {   0x3041,  0x3096,  4 }, /* Hiragana */
+    {   0xac00,  0xd7a3,  6 }, /* Hangul */
+    {  0x1f600, 0x1f64f,  1 }, /* Emoji */
+};
+
+/* Western European text, mostly ASCII */
+static const ScriptRange latin_scripts[] = {
+    {   0x0061,  0x007a, 90 }, /* ASCII */
+    {   0x0041,  0x005a,  5 }, /* ASCII uppercase */
+    {   0x00e0,  0x00ff,  4 }, /* Latin-1 */
+    {   0x0100,  0x017f,  1 }, /* Latin Extended-A */
+};
+
+/* Arabic and Hebrew text with brackets and some math */
+static const ScriptRange rtl_scripts[] = {
+    {   0x0627,  0x064a, 60 }, /* Arabic */
+    {   0x05d0,  0x05ea, 30 }, /* Hebrew */
+    {   0x0028,  0x0029,  4 }, /* parentheses */
+    {   0x2208,  0x220d,  1 }, /* element of */
+    {   0x0030,  0x0039,  5 }, /* digits */
+};
+
+/* Vietnamese text, lots of precomposed letters with two diacritics */
+static const ScriptRange vietnamese_scripts[] = {
+    {   0x0061,  0x007a, 70 }, /* ASCII */
+    {   0x1ea0,  0x1ef9, 20 }, /* Latin Extended Additional */
+    {   0x00e0,  0x00fd,  6 }, /* Latin-1 */
+    {   0x01a0,  0x01b0,  4 }, /* O/U with horn */
+};
+
+/* Hebrew text with vowel points and cantillation marks */
+static const ScriptRange hebrew_scripts[] = {
+    {   0x05d0,  0x05ea, 60 }, /* letters */
+    {   0x05b0,  0x05bc, 30 }, /* points */
+    {   0x0591,  0x05ae, 10 }, /* accents */
+};
+
+/* Korean text, Hangul syllables and some ASCII */
+static const ScriptRange korean_scripts[] = {
+    {   0xac00,  0xd7a3, 90 }, /* Hangul */
+    {   0x0061,  0x007a, 10 }, /* ASCII */
+};
+
+static const Corpus corpora[] = {
+    { "mixed-script", mixed_scripts,
+      sizeof(mixed_scripts) / sizeof(ScriptRange) },
+    { "latin", latin_scripts, sizeof(latin_scripts) / sizeof(ScriptRange) },
+    { "rtl", rtl_scripts, sizeof(rtl_scripts) / sizeof(ScriptRange) },
+};
+
+static const Corpus compose_corpora[] = {
+    { "latin", latin_scripts, sizeof(latin_scripts) / sizeof(ScriptRange) },
+    { "vietnamese", vietnamese_scripts,
+      sizeof(vietnamese_scripts) / sizeof(ScriptRange) },
+    { "hebrew", hebrew_scripts,
+      sizeof(hebrew_scripts) / sizeof(ScriptRange) },
+    { "korean", korean_scripts,
+      sizeof(korean_scripts) / sizeof(ScriptRange) },
+};
+
+static const uint32_t corpus_punctuation[] = {
+    0x0020, 0x0020, 0x0020, 0x0020, 0x002c, 0x002e, 0x000a, 0x0028, 0x0029,
+    0x0031, 0x3001, 0x3002, 0x060c, 0x00a0
+};
+
+static unsigned long rng_state = 1;
+
+static unsigned long rng(void)
+{
+    rng_state = rng_state * 1103515245UL + 12345UL;
+    return (rng_state >> 16) & 0x7fff;
+}
+
+/* Fill buffer with words of random scripts, separated by punctuation. */
+static void make_corpus(uint32_t *corpus, size_t len, const Corpus *def)
+{
+    size_t i = 0;
+    int total = 0;
+    int n;
+
+    for (n = 0; n < def->len; n++)
+        total += def->scripts[n].weight;
+
+    while (i < len) {
+        const ScriptRange *range = def->scripts;
+        int pick = (int)(rng() % total);
+        int words = 1 + (int)(rng() % 8);
+
+        while (pick >= range->weight) {
+            pick -= range->weight;
+            range++;
+        }
+
+        while (words-- && i < len) {
+            int word_len = 1 + (int)(rng() % 9);
+
+            while (word_len-- && i < len)
+                corpus[i++] = range->first +
+                    (uint32_t)(rng() % (range->last - range->first + 1));
+            if (i < len)
+                corpus[i++] = corpus_punctuation[rng() %
+                    (sizeof(corpus_punctuation) / sizeof(uint32_t))];
+        }
+    }
+}
+
+/*
+ * Mirroring with a bsearch() in the sorted table of mirror pairs, as
+ * ucdn_mirror() did before its trie. The table is rebuilt from
+ * ucdn_mirror(), so the results are the same.
+ */
+typedef struct {
+    uint32_t from, to;
+} MirrorPair;
+
+#define MIRROR_PAIRS_MAX 1024
+
+static MirrorPair mirror_pairs[MIRROR_PAIRS_MAX];
+static size_t mirror_len;
+
+static void make_mirror_pairs(void)
+{
+    uint32_t c;
+
+    /* all mirrored characters are in the BMP */
+    for (c = 0; c < 0x10000 && mirror_len < MIRROR_PAIRS_MAX; c++) {
+        if (ucdn_mirror(c) != c) {
+            mirror_pairs[mirror_len].from = c;
+            mirror_pairs[mirror_len].to = ucdn_mirror(c);
+            mirror_len++;
+        }
+    }
+}
+
+static int compare_mp(const void *a, const void *b)
+{
+    const MirrorPair *mpa = (const MirrorPair *)a;
+    const MirrorPair *mpb = (const MirrorPair *)b;
+
+    return mpa->from < mpb->from ? -1 : mpa->from > mpb->from;
+}
+
+static uint32_t mirror_bsearch(uint32_t code)
+{
+    MirrorPair mp, *res;
+
+    mp.from = code;
+    mp.to = 0;
+    res = (MirrorPair *)bsearch(&mp, mirror_pairs, mirror_len,
+                                sizeof(MirrorPair), compare_mp);
+    return res ? res->to : code;
+}
+
+/*
+ * Run each benchmark for a number of rounds and take the fastest one, to
+ * filter out noise from other processes.
+ */
+#define BENCH(t, rounds, body) do { \
+    int r_; \
+    (t) = 1e30; \
+    for (r_ = 0; r_ < (rounds); r_++) { \
+        clock_t start_ = clock(); \
+        double t_; \
+        body; \
+        t_ = (double)(clock() - start_) / CLOCKS_PER_SEC; \
+        if (t_ < (t)) \
+            (t) = t_; \
+    } \
+} while (0)
+
+/*
+ * Like BENCH, but run a baseline and the code compared against it in turns,
+ * so that clock frequency drift over the run does not skew their ratio.
+ */
+#define BENCH_PAIR(t_base, t, rounds, base_body, body) do { \
+    int p_; \
+    double b_, m_; \
+    (t_base) = (t) = 1e30; \
+    for (p_ = 0; p_ < (rounds); p_++) { \
+        BENCH(b_, 1, base_body); \
+        BENCH(m_, 1, body); \
+        if (b_ < (t_base)) \
+            (t_base) = b_; \
+        if (m_ < (t)) \
+            (t) = m_; \
+    } \
+} while (0)
+
+static void report(const char *name, size_t len, double t, double baseline)
+{
+    double mcps = (double)len / t / 1e6;
+
+    if (baseline > 0)
+        printf("%-28s %8.1f Mcp/s  (%.2fx)\n", name, mcps, baseline / t);
+    else
+        printf("%-28s %8.1f Mcp/s\n", name, mcps);
+}
+
+static void report_bytes(const char *name, size_t len, double t)
+{
+    printf("%-28s %8.1f MB/s\n", name, (double)len / t / 1e6);
+}
+
+static unsigned long bench_corpus(const Corpus *def, uint32_t *corpus,
+                                  uint8_t *out, UCDNProperties *props,
+                                  size_t *scratch, int rounds)
+{
+    unsigned long sum = 0;
+    size_t i;
+    double t_scalar, t_bsearch, t;
+
+    make_corpus(corpus, CORPUS_LEN, def);
+    printf("\n%s corpus, %d codepoints, %d rounds\n", def->name,
+           CORPUS_LEN, rounds);
+
+    /* five properties, as typically needed for shaping */
+    BENCH_PAIR(t_scalar, t, rounds,
+        for (i = 0; i < CORPUS_LEN; i++) {
+            props[i].script = (uint8_t)ucdn_get_script(corpus[i]);
+            props[i].category = (uint8_t)ucdn_get_general_category(corpus[i]);
+            props[i].bidi_class = (uint8_t)ucdn_get_bidi_class(corpus[i]);
+            props[i].combining = (uint8_t)ucdn_get_combining_class(corpus[i]);
+            props[i].linebreak_class =
+                (uint8_t)ucdn_get_linebreak_class(corpus[i]);
+        },
+        ucdn_get_properties(corpus, props, CORPUS_LEN));
+    sum += props[CORPUS_LEN - 1].script;
+    report("5 scalar getters", CORPUS_LEN, t_scalar, 0);
+    report("ucdn_get_properties", CORPUS_LEN, t, t_scalar);
+
+    /* line break opportunities of the whole corpus as one paragraph */
+    BENCH(t, rounds, ucdn_linebreaks(corpus, out, CORPUS_LEN));
+    sum += out[CORPUS_LEN / 2];
+    report("ucdn_linebreaks", CORPUS_LEN, t, 0);
+
+    /* retyping one codepoint in the middle, one update per keystroke */
+    BENCH(t, rounds,
+        for (i = 0; i < 1000; i++)
+            sum += ucdn_linebreaks_update(corpus, out, CORPUS_LEN,
+                                          CORPUS_LEN / 2 + i,
+                                          CORPUS_LEN / 2 + i + 1));
+    printf("%-28s %8.2f us/edit\n", "ucdn_linebreaks_update", t * 1e3);
+
+    BENCH(t, rounds, sum += ucdn_count_graphemes(corpus, CORPUS_LEN));
+    report("ucdn_count_graphemes", CORPUS_LEN, t, 0);
+
+    /* bidi levels of the whole corpus as one paragraph, then its order */
+    BENCH(t, rounds,
+        sum += ucdn_bidi_resolve(UCDN_BIDI_DIRECTION_AUTO, corpus,
+                                 CORPUS_LEN, out, scratch));
+    report("ucdn_bidi_resolve", CORPUS_LEN, t, 0);
+
+    BENCH(t, rounds, ucdn_bidi_reorder(out, CORPUS_LEN, scratch));
+    sum += scratch[CORPUS_LEN / 2];
+    report("ucdn_bidi_reorder", CORPUS_LEN, t, 0);
+
+    /* mirroring, as done for every RTL codepoint in bidi reordering */
+    BENCH_PAIR(t_bsearch, t, rounds,
+        for (i = 0; i < CORPUS_LEN; i++)
+            sum += mirror_bsearch(corpus[i]),
+        for (i = 0; i < CORPUS_LEN; i++)
+            sum += ucdn_mirror(corpus[i]));
+    report("bsearch mirror pairs", CORPUS_LEN, t_bsearch, 0);
+    report("ucdn_mirror", CORPUS_LEN, t, t_bsearch);
+
+    return sum;
+}
+
+/* Fully decompose a codepoint, return the number of codepoints written. */
+static size_t decompose(uint32_t code, uint32_t *out)
+{
+    uint32_t a, b;
+    size_t len;
+
+    if (!ucdn_decompose(code, &a, &b)) {
+        out[0] = code;
+        return 1;
+    }
+
+    len = decompose(a, out);
+    if (b)
+        len += decompose(b, out + len);
+    return len;
+}
+
+/*
+ * Composition with a bsearch() in the ranges of codepoints that start and
+ * end a canonical pair, then a lookup in the table of compositions, as
+ * ucdn_compose() did before its trie. The tables are rebuilt from
+ * ucdn_decompose() and ucdn_compose(), so the results are the same.
+ */
+typedef struct {
+    uint32_t start;
+    int count, index;
+} Reindex;
+
+#define REINDEX_MAX 2048
+
+static Reindex nfc_first[REINDEX_MAX], nfc_last[REINDEX_MAX];
+static size_t first_len, last_len;
+static int total_last;
+static uint32_t *comp_data;
+
+static int compare_reindex(const void *a, const void *b)
+{
+    const Reindex *ra = (const Reindex *)a;
+    const Reindex *rb = (const Reindex *)b;
+
+    if (ra->start < rb->start)
+        return -1;
+    else if (ra->start > rb->start + rb->count)
+        return 1;
+    else
+        return 0;
+}
+
+static int get_comp_index(uint32_t code, const Reindex *idx, size_t len)
+{
+    Reindex r, *res;
+
+    r.start = code;
+    r.count = r.index = 0;
+    res = (Reindex *)bsearch(&r, idx, len, sizeof(Reindex), compare_reindex);
+    return res ? res->index + (int)(code - res->start) : -1;
+}
+
+/* Hangul L + V and LV + T, which have no table entries */
+static int hangul_compose(uint32_t *code, uint32_t a, uint32_t b)
+{
+    if (a >= 0xac00 && a < 0xac00 + 11172 && (a - 0xac00) % 28 == 0 &&
+            b > 0x11a7 && b < 0x11a7 + 28) {
+        *code = a + (b - 0x11a7);
+        return 1;
+    } else if (a >= 0x1100 && a < 0x1100 + 19 &&
+            b >= 0x1161 && b < 0x1161 + 21) {
+        *code = 0xac00 + ((a - 0x1100) * 21 + (b - 0x1161)) * 28;
+        return 1;
+    }
+    return 0;
+}
+
+static int compose_bsearch(uint32_t *code, uint32_t a, uint32_t b)
+{
+    int l, r;
+
+    if (hangul_compose(code, a, b))
+        return 1;
+
+    l = get_comp_index(a, nfc_first, first_len);
+    r = get_comp_index(b, nfc_last, last_len);
+    if (l < 0 || r < 0)
+        return 0;
+
+    *code = comp_data[l * total_last + r];
+    return *code != 0;
+}
+
+/* Whether a codepoint is the canonical composition of a and b. */
+static int is_composition(uint32_t code, uint32_t *a, uint32_t *b)
+{
+    uint32_t c;
+
+    if (code >= 0xac00 && code < 0xac00 + 11172)
+        return 0;
+    return ucdn_decompose(code, a, b) && *b != 0 &&
+        ucdn_compose(&c, *a, *b) && c == code;
+}
+
+/* Number the codepoints with a role bit set, in ranges of consecutive ones. */
+static size_t make_reindex(const uint8_t *role, int bit, Reindex *idx,
+                           int *total)
+{
+    uint32_t c;
+    size_t len = 0;
+    int n = 0;
+
+    for (c = 0; c < 0x110000; c++) {
+        if (!(role[c] & bit))
+            continue;
+        if (len > 0 && idx[len - 1].start + idx[len - 1].count + 1 == c) {
+            idx[len - 1].count++;
+        } else if (len < REINDEX_MAX) {
+            idx[len].start = c;
+            idx[len].count = 0;
+            idx[len].index = n;
+            len++;
+        } else {
+            break;
+        }
+        n++;
+    }
+    *total = n;
+    return len;
+}
+
+static int make_comp_tables(void)
+{
+    uint8_t *role = calloc(0x110000, 1);
+    uint32_t c, a, b;
+    int total_first;
+
+    if (!role)
+        return 0;
+    for (c = 0; c < 0x110000; c++) {
+        if (is_composition(c, &a, &b)) {
+            role[a] |= 1;
+            role[b] |= 2;
+        }
+    }
+    first_len = make_reindex(role, 1, nfc_first, &total_first);
+    last_len = make_reindex(role, 2, nfc_last, &total_last);
+    free(role);
+
+    comp_data = calloc((size_t)total_first * total_last, sizeof(uint32_t));
+    if (!comp_data)
+        return 0;
+    for (c = 0; c < 0x110000; c++) {
+        if (is_composition(c, &a, &b))
+            comp_data[get_comp_index(a, nfc_first, first_len) * total_last +
+                      get_comp_index(b, nfc_last, last_len)] = c;
+    }
+    return 1;
+}
+
+/* Canonical reordering by insertion sort, as a simple normalizer does it. */
+static void reorder_insertion(uint32_t *code, size_t len)
+{
+    size_t i, j;
+
+    for (i = 1; i < len; i++) {
+        uint32_t c = code[i];
+        int ccc = ucdn_get_combining_class(c);
+
+        if (ccc == 0)
+            continue;
+        for (j = i; j > 0 && ucdn_get_combining_class(code[j - 1]) > ccc; j--)
+            code[j] = code[j - 1];
+        code[j] = c;
+    }
+}
+
+/* Encode codepoints as UTF-8, return the number of bytes written. */
+static size_t encode_utf8(const uint32_t *code, size_t len, uint8_t *out)
+{
+    size_t i, n = 0;
+
+    for (i = 0; i < len; i++) {
+        uint32_t c = code[i];
+        if (c < 0x80) {
+            out[n++] = (uint8_t)c;
+        } else if (c < 0x800) {
+            out[n++] = (uint8_t)(0xc0 | (c >> 6));
+            out[n++] = (uint8_t)(0x80 | (c & 0x3f));
+        } else if (c < 0x10000) {
+            out[n++] = (uint8_t)(0xe0 | (c >> 12));
+            out[n++] = (uint8_t)(0x80 | ((c >> 6) & 0x3f));
+            out[n++] = (uint8_t)(0x80 | (c & 0x3f));
+        } else {
+            out[n++] = (uint8_t)(0xf0 | (c >> 18));
+            out[n++] = (uint8_t)(0x80 | ((c >> 12) & 0x3f));
+            out[n++] = (uint8_t)(0x80 | ((c >> 6) & 0x3f));
+            out[n++] = (uint8_t)(0x80 | (c & 0x3f));
+        }
+    }
+    return n;
+}
+
+/* Normalize UTF-8 text in chunks, as read from a stream. */
+static size_t stream_utf8(int form, const uint8_t *src, size_t len,
+                          uint8_t *out)
+{
+    UCDNNormalizer n;
+    size_t pos = 0, out_len = 0, consumed, written;
+
+    ucdn_normalizer_init(&n, form);
+    while (pos < len) {
+        written = ucdn_normalizer_put_utf8(&n, src + pos,
+            len - pos < STREAM_CHUNK ? len - pos : STREAM_CHUNK,
+            &consumed, out, STREAM_CHUNK);
+        if (written == UCDN_NORMALIZE_ERROR)
+            return 0;
+        out_len += written;
+        pos += consumed;
+    }
+    do {
+        written = ucdn_normalizer_finish_utf8(&n, out, STREAM_CHUNK);
+        out_len += written;
+    } while (written > 0);
+
+    return out_len;
+}
+
+/* Segment UTF-8 text in chunks, return the number of boundaries. */
+static size_t segment_utf8(int type, const uint8_t *src, size_t len)
+{
+    static size_t boundaries[STREAM_CHUNK + 2];
+    UCDNSegmenter s;
+    size_t pos = 0, count = 0, n;
+
+    ucdn_segmenter_init(&s, type);
+    while (pos < len) {
+        n = len - pos < STREAM_CHUNK ? len - pos : STREAM_CHUNK;
+        count += ucdn_segmenter_put_utf8(&s, src + pos, n, boundaries);
+        pos += n;
+    }
+    return count + ucdn_segmenter_finish(&s, boundaries);
+}
+
+/*
+ * Pairwise composition of adjacent codepoints of decomposed text, as done
+ * by an NFC normalizer, and full string normalization of the same text.
+ */
+static unsigned long bench_compose(const Corpus *def, uint32_t *corpus,
+                                   uint32_t *decomposed, uint8_t *utf8,
+                                   uint8_t *utf8_out, int rounds)
+{
+    unsigned long sum = 0;
+    size_t i, n, len = 0, len8;
+    double t, t_recursive, t_bsearch;
+
+    make_corpus(corpus, CORPUS_LEN, def);
+    for (i = 0; i < CORPUS_LEN && len + 4 < 2 * CORPUS_LEN; i++)
+        len += decompose(corpus[i], decomposed + len);
+
+    printf("\n%s corpus decomposed, %d codepoints, %d rounds\n", def->name,
+           (int)len, rounds);
+
+    BENCH(t_recursive, rounds,
+        for (i = 0, n = 0; i < CORPUS_LEN && n + 4 < 2 * CORPUS_LEN; i++)
+            n += decompose(corpus[i], decomposed + n));
+    report("recursive ucdn_decompose", i, t_recursive, 0);
+
+    BENCH(t, rounds,
+        for (i = 0, n = 0; i < CORPUS_LEN && n + 4 < 2 * CORPUS_LEN; i++) {
+            int d = ucdn_canonical_decompose_full(corpus[i], decomposed + n);
+            if (d == 0)
+                decomposed[n++] = corpus[i];
+            n += d;
+        });
+    report("ucdn_canonical_decompose_full", i, t, t_recursive);
+
+    BENCH(t, rounds,
+        for (i = 0, n = 0; i < CORPUS_LEN && n + 18 < 2 * CORPUS_LEN; i++) {
+            int d = ucdn_compat_decompose(corpus[i], decomposed + n);
+            if (d == 0)
+                decomposed[n++] = corpus[i];
+            n += d;
+        });
+    report("ucdn_compat_decompose", i, t, 0);
+
+    BENCH_PAIR(t_bsearch, t, rounds,
+        for (i = 0; i + 1 < len; i++) {
+            uint32_t c;
+            if (compose_bsearch(&c, decomposed[i], decomposed[i + 1]))
+                sum += c;
+        },
+        for (i = 0; i + 1 < len; i++) {
+            uint32_t c;
+            if (ucdn_compose(&c, decomposed[i], decomposed[i + 1]))
+                sum += c;
+        });
+    report("bsearch composition ranges", len - 1, t_bsearch, 0);
+    report("ucdn_compose", len - 1, t, t_bsearch);
+
+    /* the output buffers hold CORPUS_LEN codepoints */
+    n = len < CORPUS_LEN ? len : CORPUS_LEN;
+    BENCH(t_recursive, rounds,
+        memcpy(corpus, decomposed, n * sizeof(uint32_t));
+        reorder_insertion(corpus, n));
+    report("insertion sort reordering", n, t_recursive, 0);
+
+    BENCH(t, rounds,
+        ucdn_canonical_reorder(decomposed, n, corpus, utf8_out));
+    report("ucdn_canonical_reorder", n, t, t_recursive);
+
+    BENCH(t, rounds,
+        sum += ucdn_normalize(UCDN_NORMALIZATION_NFC, decomposed, len,
+                              corpus, CORPUS_LEN));
+    report("ucdn_normalize NFC", len, t, 0);
+
+    BENCH(t, rounds,
+        sum += ucdn_normalize(UCDN_NORMALIZATION_NFD, corpus, CORPUS_LEN,
+                              decomposed, 2 * CORPUS_LEN));
+    report("ucdn_normalize NFD", CORPUS_LEN, t, 0);
+
+    BENCH(t, rounds,
+        sum += ucdn_normalized_prefix(UCDN_NORMALIZATION_NFC, corpus,
+                                      CORPUS_LEN));
+    report("ucdn_normalized_prefix NFC", CORPUS_LEN, t, 0);
+
+    len8 = encode_utf8(corpus, CORPUS_LEN, utf8);
+    BENCH(t, rounds,
+        sum += ucdn_normalized_prefix_utf8(UCDN_NORMALIZATION_NFC, utf8,
+                                           len8));
+    report_bytes("ucdn_normalized_prefix_utf8", len8, t);
+
+    BENCH(t, rounds,
+        sum += ucdn_normalize_utf8(UCDN_NORMALIZATION_NFC, utf8, len8,
+                                   utf8_out, 8 * CORPUS_LEN));
+    report_bytes("ucdn_normalize_utf8 NFC", len8, t);
+
+    BENCH(t, rounds,
+        sum += ucdn_normalize_utf8(UCDN_NORMALIZATION_NFD, utf8, len8,
+                                   utf8_out, 8 * CORPUS_LEN));
+    report_bytes("ucdn_normalize_utf8 NFD", len8, t);
+
+    BENCH(t, rounds,
+        sum += stream_utf8(UCDN_NORMALIZATION_NFC, utf8, len8, utf8_out));
+    report_bytes("ucdn_normalizer_put_utf8 NFC", len8, t);
+
+    BENCH(t, rounds,
+        sum += ucdn_lowercase_utf8(utf8, len8, utf8_out, 8 * CORPUS_LEN));
+    report_bytes("ucdn_lowercase_utf8", len8, t);
+
+    BENCH(t, rounds,
+        sum += ucdn_uppercase_utf8(utf8, len8, utf8_out, 8 * CORPUS_LEN));
+    report_bytes("ucdn_uppercase_utf8", len8, t);
+
+    BENCH(t, rounds,
+        sum += ucdn_casefold_utf8(UCDN_CASEFOLD_FULL, utf8, len8, utf8_out,
+                                  8 * CORPUS_LEN));
+    report_bytes("ucdn_casefold_utf8", len8, t);
+
+    BENCH(t, rounds,
+        sum += ucdn_casefold_hash_utf8(UCDN_CASEFOLD_FULL, utf8, len8,
+                                       UCDN_CASEFOLD_HASH_INIT));
+    report_bytes("ucdn_casefold_hash_utf8", len8, t);
+
+    BENCH(t, rounds,
+        sum += ucdn_casefold_hash_utf8(UCDN_CASEFOLD_NFKC, utf8, len8,
+                                       UCDN_CASEFOLD_HASH_INIT));
+    report_bytes("ucdn_casefold_hash_utf8 NFKC", len8, t);
+
+    BENCH(t, rounds, sum += ucdn_count_graphemes_utf8(utf8, len8));
+    report_bytes("ucdn_count_graphemes_utf8", len8, t);
+
+    BENCH(t, rounds, sum += segment_utf8(UCDN_SEGMENT_WORD, utf8, len8));
+    report_bytes("ucdn_segmenter_put_utf8 WB", len8, t);
+
+    BENCH(t, rounds, sum += segment_utf8(UCDN_SEGMENT_SENTENCE, utf8, len8));
+    report_bytes("ucdn_segmenter_put_utf8 SB", len8, t);
+
+    BENCH(t, rounds,
+        sum += ucdn_normalize(UCDN_NORMALIZATION_NFKC, decomposed, len,
+                              corpus, CORPUS_LEN));
+    report("ucdn_normalize NFKC", len, t, 0);
+
+    return sum;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t *corpus, *decomposed;
+    uint8_t *out, *utf8, *utf8_out;
+    UCDNProperties *props;
+    size_t *scratch;
+    unsigned long sum = 0;
+    int c, layout, rounds = 5;
+
+    if (argc > 1)
+        rounds = atoi(argv[1]);
+
+    corpus = malloc(CORPUS_LEN * sizeof(uint32_t));
+    out = malloc(CORPUS_LEN);
+    props = malloc(CORPUS_LEN * sizeof(UCDNProperties));
+    decomposed = malloc(2 * CORPUS_LEN * sizeof(uint32_t));
+    utf8 = malloc(4 * CORPUS_LEN);
+    utf8_out = malloc(8 * CORPUS_LEN);
+    scratch = malloc(UCDN_BIDI_SCRATCH_LEN(CORPUS_LEN) * sizeof(size_t));
+    if (!corpus || !out || !props || !decomposed || !utf8 || !utf8_out ||
+            !scratch || !make_comp_tables())
+        return EXIT_FAILURE;
+
+    layout = ucdn_get_table_layout();
+    printf("table layout:%s%s%s%s%s\n",
+           layout ? "" : " compact",
+           layout & UCDN_LAYOUT_FLAT_BMP ? " flat-bmp" : "",
+           layout & UCDN_LAYOUT_PACKED_RECORDS ? " packed-records" : "",
+           layout & UCDN_LAYOUT_PROPERTY_TRIES ? " property-tries" : "",
+           layout & UCDN_LAYOUT_UTF32_DECOMP ? " utf32-decomp" : "");
+
+    make_mirror_pairs();
+    for (c = 0; c < (int)(sizeof(corpora) / sizeof(Corpus)); c++)
+        sum += bench_corpus(&corpora[c], corpus, out, props, scratch,
+                            rounds);
+
+    for (c = 0; c < (int)(sizeof(compose_corpora) / sizeof(Corpus)); c++)
+        sum += bench_compose(&compose_corpora[c], corpus, decomposed,
+                             utf8, utf8_out, rounds);
+
+    printf("checksum %lu\n", sum);
+
+    free(corpus);
+    free(out);
+    free(props);
+    free(decomposed);
+    free(scratch);
+    free(utf8);
+    free(utf8_out);
+    free(comp_data);
+
+    return EXIT_SUCCESS;
+}
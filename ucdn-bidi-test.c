@@ -0,0 +1,279 @@
+/*
+ * Copyright (C) 2012 Grigori Goronzy <greg@kinoho.net>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Conformance test of the bidirectional algorithm against BidiTest.txt
+ * and BidiCharacterTest.txt from the Unicode Character Database. The
+ * format is taken from the file name. BidiTest.txt lists bidi classes,
+ * which are tested with a representative codepoint of each class.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ucdn.h"
+
+#define MAX_LEN 256
+#define REMOVED -1
+
+typedef struct {
+    uint32_t code[MAX_LEN];
+    size_t len;
+    int levels[MAX_LEN];
+    size_t order[MAX_LEN];
+    size_t order_len;
+} Case;
+
+static const struct {
+    const char *name;
+    uint32_t code;
+} classes[] = {
+    {"L", 0x0061}, {"LRE", 0x202a}, {"LRO", 0x202d}, {"R", 0x05d0},
+    {"AL", 0x0627}, {"RLE", 0x202b}, {"RLO", 0x202e}, {"PDF", 0x202c},
+    {"EN", 0x0031}, {"ES", 0x002b}, {"ET", 0x0023}, {"AN", 0x0660},
+    {"CS", 0x002c}, {"NSM", 0x0300}, {"BN", 0x00ad}, {"B", 0x2029},
+    {"S", 0x0009}, {"WS", 0x0020}, {"ON", 0x0021}, {"LRI", 0x2066},
+    {"RLI", 0x2067}, {"FSI", 0x2068}, {"PDI", 0x2069}
+};
+
+static int failures;
+static unsigned long line_no;
+
+static int is_removed(uint32_t code)
+{
+    switch (ucdn_get_bidi_class(code)) {
+    case UCDN_BIDI_CLASS_LRE:
+    case UCDN_BIDI_CLASS_RLE:
+    case UCDN_BIDI_CLASS_LRO:
+    case UCDN_BIDI_CLASS_RLO:
+    case UCDN_BIDI_CLASS_PDF:
+    case UCDN_BIDI_CLASS_BN:
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * Resolve each paragraph of the case and compare the levels and the
+ * visual order without the removed characters. Returns the level of
+ * the first paragraph.
+ */
+static int check(const Case *c, int direction)
+{
+    static size_t scratch[UCDN_BIDI_SCRATCH_LEN(MAX_LEN)];
+    uint8_t levels[MAX_LEN];
+    size_t order[MAX_LEN], start = 0, end, i, n = 0;
+    int level = -1, para;
+
+    while (start < c->len) {
+        /* a paragraph separator ends a paragraph */
+        for (end = start; end < c->len; end++) {
+            if (ucdn_get_bidi_class(c->code[end]) == UCDN_BIDI_CLASS_B) {
+                end++;
+                break;
+            }
+        }
+        para = ucdn_bidi_resolve(direction, c->code + start, end - start,
+                                 levels + start, scratch);
+        if (level < 0)
+            level = para;
+        ucdn_bidi_reorder(levels + start, end - start, order + start);
+        for (i = start; i < end; i++)
+            order[i] += start;
+        start = end;
+    }
+
+    for (i = 0; i < c->len; i++) {
+        if (c->levels[i] != REMOVED && c->levels[i] != levels[i]) {
+            printf("line %lu: level mismatch at %lu (direction %d)\n",
+                   line_no, (unsigned long)i, direction);
+            failures++;
+            return level;
+        }
+    }
+    for (i = 0; i < c->len; i++) {
+        if (is_removed(c->code[order[i]]))
+            continue;
+        if (n == c->order_len || c->order[n] != order[i])
+            break;
+        n++;
+    }
+    if (i < c->len || n != c->order_len) {
+        printf("line %lu: order mismatch (direction %d)\n", line_no,
+               direction);
+        failures++;
+    }
+    return level;
+}
+
+/* parse levels like "x 1 2", returns the number parsed */
+static size_t parse_levels(const char *p, int *levels)
+{
+    size_t n = 0;
+    char *end;
+
+    for (;;) {
+        while (*p == ' ' || *p == '\t')
+            p++;
+        if (*p == 'x') {
+            levels[n++] = REMOVED;
+            p++;
+        } else if (*p >= '0' && *p <= '9') {
+            levels[n++] = (int)strtol(p, &end, 10);
+            p = end;
+        } else {
+            return n;
+        }
+        if (n == MAX_LEN)
+            return n;
+    }
+}
+
+static size_t parse_order(const char *p, size_t *order)
+{
+    size_t n = 0;
+    char *end;
+
+    for (;;) {
+        while (*p == ' ' || *p == '\t')
+            p++;
+        if (*p < '0' || *p > '9' || n == MAX_LEN)
+            return n;
+        order[n++] = (size_t)strtoul(p, &end, 10);
+        p = end;
+    }
+}
+
+/* "0061 05D0;2;0;0 1;0 1" */
+static int parse_character_test(char *p, Case *c, int *direction,
+                                 int *level)
+{
+    char *field[5], *end;
+    int i;
+
+    for (i = 0; i < 5; i++) {
+        field[i] = p;
+        p = strchr(p, i < 4 ? ';' : '\n');
+        if (p == NULL && i < 4)
+            return 0;
+        if (p != NULL)
+            *p++ = '\0';
+    }
+
+    c->len = 0;
+    p = field[0];
+    for (;;) {
+        while (*p == ' ')
+            p++;
+        if (*p == '\0')
+            break;
+        if (c->len == MAX_LEN)
+            return 0;
+        c->code[c->len++] = (uint32_t)strtoul(p, &end, 16);
+        if (end == p)
+            return 0;
+        p = end;
+    }
+    *direction = atoi(field[1]);
+    *level = atoi(field[2]);
+    c->order_len = parse_order(field[4], c->order);
+    return parse_levels(field[3], c->levels) == c->len;
+}
+
+/* "L LRE; 7", with the class names mapped to codepoints */
+static int parse_class_test(char *p, Case *c, int *directions)
+{
+    size_t n, k;
+
+    c->len = 0;
+    for (;;) {
+        while (*p == ' ' || *p == '\t')
+            p++;
+        if (*p == ';')
+            break;
+        for (n = 0; p[n] >= 'A' && p[n] <= 'Z'; n++)
+            ;
+        if (n == 0 || c->len == MAX_LEN)
+            return 0;
+        for (k = 0; k < sizeof(classes) / sizeof(classes[0]); k++) {
+            if (strlen(classes[k].name) == n &&
+                    strncmp(classes[k].name, p, n) == 0)
+                break;
+        }
+        if (k == sizeof(classes) / sizeof(classes[0]))
+            return 0;
+        c->code[c->len++] = classes[k].code;
+        p += n;
+    }
+    *directions = atoi(p + 1);
+    return 1;
+}
+
+int main(int argc, char **argv)
+{
+    const char *filename = argc > 1 ? argv[1] : "BidiCharacterTest.txt";
+    static const int direction_bits[3] = {2, 4, 1};
+    char buf[4096];
+    unsigned long tests = 0;
+    int character_test, direction, level, directions, i;
+    size_t expected_len = 0;
+    Case c;
+    FILE *f;
+
+    f = fopen(filename, "r");
+    if (f == NULL) {
+        printf("cannot open %s\n", filename);
+        return EXIT_FAILURE;
+    }
+    character_test = strstr(filename, "BidiCharacterTest") != NULL;
+
+    while (fgets(buf, sizeof(buf), f)) {
+        line_no++;
+        if (buf[0] == '#' || buf[0] == '\n' || buf[0] == '\r')
+            continue;
+
+        if (character_test) {
+            if (!parse_character_test(buf, &c, &direction, &level)) {
+                printf("line %lu: parse error\n", line_no);
+                return EXIT_FAILURE;
+            }
+            if (check(&c, direction) != level) {
+                printf("line %lu: paragraph level mismatch\n", line_no);
+                failures++;
+            }
+            tests++;
+        } else if (strncmp(buf, "@Levels:", 8) == 0) {
+            expected_len = parse_levels(buf + 8, c.levels);
+        } else if (strncmp(buf, "@Reorder:", 9) == 0) {
+            c.order_len = parse_order(buf + 9, c.order);
+        } else if (buf[0] != '@') {
+            if (!parse_class_test(buf, &c, &directions) ||
+                    c.len != expected_len) {
+                printf("line %lu: parse error\n", line_no);
+                return EXIT_FAILURE;
+            }
+            for (i = 0; i < 3; i++) {
+                if (directions & direction_bits[i])
+                    check(&c, i);
+            }
+            tests++;
+        }
+    }
+    fclose(f);
+
+    printf("%lu test lines, %d failures\n", tests, failures);
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,316 @@
+/*
+ * Copyright (C) 2012 Grigori Goronzy <greg@kinoho.net>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Conformance test of the string normalizer against NormalizationTest.txt
+ * from the Unicode Character Database.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ucdn.h"
+
+#define MAX_LEN 128
+
+typedef struct {
+    uint32_t code[MAX_LEN];
+    size_t len;
+} String;
+
+static int failures;
+static unsigned long line_no;
+
+static size_t to_utf16(const String *s, uint16_t *out)
+{
+    size_t i, len = 0;
+
+    for (i = 0; i < s->len; i++) {
+        uint32_t c = s->code[i];
+        if (c < 0x10000) {
+            out[len++] = (uint16_t)c;
+        } else {
+            out[len++] = (uint16_t)(0xd800 + ((c - 0x10000) >> 10));
+            out[len++] = (uint16_t)(0xdc00 + (c & 0x3ff));
+        }
+    }
+    return len;
+}
+
+static size_t to_utf8(const String *s, uint8_t *out)
+{
+    size_t i, len = 0;
+
+    for (i = 0; i < s->len; i++) {
+        uint32_t c = s->code[i];
+        if (c < 0x80) {
+            out[len++] = (uint8_t)c;
+        } else if (c < 0x800) {
+            out[len++] = (uint8_t)(0xc0 | (c >> 6));
+            out[len++] = (uint8_t)(0x80 | (c & 0x3f));
+        } else if (c < 0x10000) {
+            out[len++] = (uint8_t)(0xe0 | (c >> 12));
+            out[len++] = (uint8_t)(0x80 | ((c >> 6) & 0x3f));
+            out[len++] = (uint8_t)(0x80 | (c & 0x3f));
+        } else {
+            out[len++] = (uint8_t)(0xf0 | (c >> 18));
+            out[len++] = (uint8_t)(0x80 | ((c >> 12) & 0x3f));
+            out[len++] = (uint8_t)(0x80 | ((c >> 6) & 0x3f));
+            out[len++] = (uint8_t)(0x80 | (c & 0x3f));
+        }
+    }
+    return len;
+}
+
+static const char *form_name(int form)
+{
+    switch (form) {
+    case UCDN_NORMALIZATION_NFD:
+        return "NFD";
+    case UCDN_NORMALIZATION_NFKD:
+        return "NFKD";
+    case UCDN_NORMALIZATION_NFKC:
+        return "NFKC";
+    default:
+        return "NFC";
+    }
+}
+
+/*
+ * Normalize in chunks of chunk code units into an output buffer of
+ * dst_len code units, return the length of the output.
+ */
+static size_t stream32(int form, const uint32_t *src, size_t len,
+                       size_t chunk, size_t dst_len, uint32_t *out)
+{
+    UCDNNormalizer n;
+    size_t pos = 0, out_len = 0, consumed, written;
+
+    ucdn_normalizer_init(&n, form);
+    while (pos < len) {
+        written = ucdn_normalizer_put(&n, src + pos,
+                                      len - pos < chunk ? len - pos : chunk,
+                                      &consumed, out + out_len, dst_len);
+        if (written == UCDN_NORMALIZE_ERROR)
+            return 0;
+        out_len += written;
+        pos += consumed;
+    }
+    do {
+        written = ucdn_normalizer_finish(&n, out + out_len, dst_len);
+        out_len += written;
+    } while (written > 0);
+    return out_len;
+}
+
+static size_t stream8(int form, const uint8_t *src, size_t len,
+                      size_t chunk, size_t dst_len, uint8_t *out)
+{
+    UCDNNormalizer n;
+    size_t pos = 0, out_len = 0, consumed, written;
+
+    ucdn_normalizer_init(&n, form);
+    while (pos < len) {
+        written = ucdn_normalizer_put_utf8(&n, src + pos,
+                                           len - pos < chunk ? len - pos : chunk,
+                                           &consumed, out + out_len, dst_len);
+        if (written == UCDN_NORMALIZE_ERROR)
+            return 0;
+        out_len += written;
+        pos += consumed;
+    }
+    do {
+        written = ucdn_normalizer_finish_utf8(&n, out + out_len, dst_len);
+        out_len += written;
+    } while (written > 0);
+    return out_len;
+}
+
+/* Check that normalizing src in every encoding yields expected. */
+static void check(int form, const String *src, const String *expected)
+{
+    uint32_t out32[4 * MAX_LEN];
+    uint16_t in16[2 * MAX_LEN], out16[8 * MAX_LEN], exp16[2 * MAX_LEN];
+    uint8_t in8[4 * MAX_LEN], out8[16 * MAX_LEN], exp8[4 * MAX_LEN];
+    size_t len, len16, len8, in_len8, prefix;
+
+    len = ucdn_normalize(form, src->code, src->len, out32, 4 * MAX_LEN);
+    if (len != expected->len ||
+            memcmp(out32, expected->code, len * sizeof(uint32_t)) != 0) {
+        printf("line %lu: %s mismatch (UTF-32)\n", line_no, form_name(form));
+        failures++;
+        return;
+    }
+
+    /* the normalized prefix must be unchanged by normalizing the rest */
+    prefix = ucdn_normalized_prefix(form, src->code, src->len);
+    if (prefix > expected->len ||
+            memcmp(src->code, expected->code, prefix * sizeof(uint32_t)) ||
+            ucdn_normalize(form, src->code + prefix, src->len - prefix,
+                           out32, 4 * MAX_LEN) != expected->len - prefix ||
+            memcmp(out32, expected->code + prefix,
+                   (expected->len - prefix) * sizeof(uint32_t)) != 0) {
+        printf("line %lu: %s prefix mismatch\n", line_no, form_name(form));
+        failures++;
+        return;
+    }
+
+    len16 = to_utf16(expected, exp16);
+    len = ucdn_normalize_utf16(form, in16, to_utf16(src, in16),
+                               out16, 8 * MAX_LEN);
+    if (len != len16 || memcmp(out16, exp16, len * sizeof(uint16_t)) != 0) {
+        printf("line %lu: %s mismatch (UTF-16)\n", line_no, form_name(form));
+        failures++;
+        return;
+    }
+
+    len8 = to_utf8(expected, exp8);
+    in_len8 = to_utf8(src, in8);
+    len = ucdn_normalize_utf8(form, in8, in_len8, out8, 16 * MAX_LEN);
+    if (len != len8 || memcmp(out8, exp8, len) != 0) {
+        printf("line %lu: %s mismatch (UTF-8)\n", line_no, form_name(form));
+        failures++;
+        return;
+    }
+
+    /* none of the test strings needs a CGJ for Stream-Safe Text Format */
+    len = ucdn_normalize(form | UCDN_NORMALIZATION_STREAM_SAFE, src->code,
+                         src->len, out32, 4 * MAX_LEN);
+    if (len != expected->len ||
+            memcmp(out32, expected->code, len * sizeof(uint32_t)) != 0) {
+        printf("line %lu: %s mismatch (stream-safe)\n", line_no,
+               form_name(form));
+        failures++;
+        return;
+    }
+
+    /* streaming, with chunk and output buffer sizes varying by line */
+    len = stream32(form, src->code, src->len, 1 + line_no % 3,
+                   1 + line_no % 5, out32);
+    if (len != expected->len ||
+            memcmp(out32, expected->code, len * sizeof(uint32_t)) != 0) {
+        printf("line %lu: %s mismatch (UTF-32 stream)\n", line_no,
+               form_name(form));
+        failures++;
+        return;
+    }
+    len = stream8(form | (line_no & 1 ? UCDN_NORMALIZATION_STREAM_SAFE : 0),
+                  in8, in_len8, 1 + line_no % 7, 4 + line_no % 5, out8);
+    if (len != len8 || memcmp(out8, exp8, len) != 0) {
+        printf("line %lu: %s mismatch (UTF-8 stream)\n", line_no,
+               form_name(form));
+        failures++;
+    }
+}
+
+static int parse_string(char **p, String *s)
+{
+    char *end;
+
+    s->len = 0;
+    while (**p == ' ')
+        (*p)++;
+    while (**p != ';') {
+        if (**p == '\0' || s->len == MAX_LEN)
+            return 0;
+        s->code[s->len++] = (uint32_t)strtoul(*p, &end, 16);
+        if (end == *p)
+            return 0;
+        *p = end;
+        while (**p == ' ')
+            (*p)++;
+    }
+    (*p)++;
+    return 1;
+}
+
+int main(int argc, char **argv)
+{
+    const char *filename = argc > 1 ? argv[1] : "NormalizationTest.txt";
+    static char part1[0x110000];
+    char buf[4096];
+    String c[5], single;
+    int i, in_part1 = 0;
+    unsigned long tests = 0;
+    uint32_t code;
+    FILE *f;
+
+    f = fopen(filename, "r");
+    if (f == NULL) {
+        printf("cannot open %s\n", filename);
+        return EXIT_FAILURE;
+    }
+
+    while (fgets(buf, sizeof(buf), f)) {
+        char *p = buf;
+
+        line_no++;
+        if (buf[0] == '#' || buf[0] == '\n')
+            continue;
+        if (buf[0] == '@') {
+            in_part1 = strncmp(buf, "@Part1", 6) == 0;
+            continue;
+        }
+
+        for (i = 0; i < 5; i++) {
+            if (!parse_string(&p, &c[i])) {
+                printf("line %lu: parse error\n", line_no);
+                return EXIT_FAILURE;
+            }
+        }
+        if (in_part1 && c[0].len == 1)
+            part1[c[0].code[0]] = 1;
+
+        /* c2 == NFC(c1) == NFC(c2) == NFC(c3), c4 == NFC(c4) == NFC(c5) */
+        check(UCDN_NORMALIZATION_NFC, &c[0], &c[1]);
+        check(UCDN_NORMALIZATION_NFC, &c[1], &c[1]);
+        check(UCDN_NORMALIZATION_NFC, &c[2], &c[1]);
+        check(UCDN_NORMALIZATION_NFC, &c[3], &c[3]);
+        check(UCDN_NORMALIZATION_NFC, &c[4], &c[3]);
+
+        /* c3 == NFD(c1) == NFD(c2) == NFD(c3), c5 == NFD(c4) == NFD(c5) */
+        check(UCDN_NORMALIZATION_NFD, &c[0], &c[2]);
+        check(UCDN_NORMALIZATION_NFD, &c[1], &c[2]);
+        check(UCDN_NORMALIZATION_NFD, &c[2], &c[2]);
+        check(UCDN_NORMALIZATION_NFD, &c[3], &c[4]);
+        check(UCDN_NORMALIZATION_NFD, &c[4], &c[4]);
+
+        /* c4 == NFKC(c1) == NFKC(c2) == ... == NFKC(c5) */
+        /* c5 == NFKD(c1) == NFKD(c2) == ... == NFKD(c5) */
+        for (i = 0; i < 5; i++) {
+            check(UCDN_NORMALIZATION_NFKC, &c[i], &c[3]);
+            check(UCDN_NORMALIZATION_NFKD, &c[i], &c[4]);
+        }
+        tests++;
+    }
+    fclose(f);
+
+    /* all characters not listed in part 1 are invariant */
+    line_no = 0;
+    single.len = 1;
+    for (code = 0; code < 0x110000; code++) {
+        if (part1[code] || (code >= 0xd800 && code < 0xe000))
+            continue;
+        single.code[0] = code;
+        check(UCDN_NORMALIZATION_NFC, &single, &single);
+        check(UCDN_NORMALIZATION_NFD, &single, &single);
+        check(UCDN_NORMALIZATION_NFKC, &single, &single);
+        check(UCDN_NORMALIZATION_NFKD, &single, &single);
+    }
+
+    printf("%lu test lines, %d failures\n", tests, failures);
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
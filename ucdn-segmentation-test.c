@@ -0,0 +1,358 @@
+/*
+ * Copyright (C) 2012 Grigori Goronzy <greg@kinoho.net>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Conformance test of text segmentation against GraphemeBreakTest.txt,
+ * WordBreakTest.txt, SentenceBreakTest.txt and LineBreakTest.txt from the
+ * Unicode Character Database. The kind of boundaries is taken from the
+ * file name.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ucdn.h"
+
+#define MAX_LEN 128
+
+typedef struct {
+    uint32_t code[MAX_LEN];
+    size_t len;
+    /* boundary[i] is set if there is a boundary before code[i] */
+    char boundary[MAX_LEN + 1];
+} Case;
+
+#define GRAPHEME -1
+#define LINE -2
+
+static int failures;
+static unsigned long line_no;
+static int type = GRAPHEME;
+
+static size_t to_utf16(const Case *c, uint16_t *out, size_t *offsets)
+{
+    size_t i, len = 0;
+
+    for (i = 0; i < c->len; i++) {
+        uint32_t code = c->code[i];
+        offsets[i] = len;
+        if (code < 0x10000) {
+            out[len++] = (uint16_t)code;
+        } else {
+            out[len++] = (uint16_t)(0xd800 + ((code - 0x10000) >> 10));
+            out[len++] = (uint16_t)(0xdc00 + (code & 0x3ff));
+        }
+    }
+    offsets[i] = len;
+    return len;
+}
+
+static size_t to_utf8(const Case *c, uint8_t *out, size_t *offsets)
+{
+    size_t i, len = 0;
+
+    for (i = 0; i < c->len; i++) {
+        uint32_t code = c->code[i];
+        offsets[i] = len;
+        if (code < 0x80) {
+            out[len++] = (uint8_t)code;
+        } else if (code < 0x800) {
+            out[len++] = (uint8_t)(0xc0 | (code >> 6));
+            out[len++] = (uint8_t)(0x80 | (code & 0x3f));
+        } else if (code < 0x10000) {
+            out[len++] = (uint8_t)(0xe0 | (code >> 12));
+            out[len++] = (uint8_t)(0x80 | ((code >> 6) & 0x3f));
+            out[len++] = (uint8_t)(0x80 | (code & 0x3f));
+        } else {
+            out[len++] = (uint8_t)(0xf0 | (code >> 18));
+            out[len++] = (uint8_t)(0x80 | ((code >> 12) & 0x3f));
+            out[len++] = (uint8_t)(0x80 | ((code >> 6) & 0x3f));
+            out[len++] = (uint8_t)(0x80 | (code & 0x3f));
+        }
+    }
+    offsets[i] = len;
+    return len;
+}
+
+/*
+ * Check that iterating from boundary to boundary visits exactly the
+ * expected boundaries, given as offsets of the codepoints in the
+ * encoding.
+ */
+static int check_offsets(const Case *c, const size_t *offsets, size_t len,
+                         size_t (*next)(const void *, size_t, size_t),
+                         const void *src)
+{
+    size_t pos = 0, i = 1;
+
+    while (pos < len) {
+        pos = next(src, len, pos);
+        while (i < c->len && !c->boundary[i])
+            i++;
+        if (pos != offsets[i])
+            return 0;
+        i++;
+    }
+    return i == c->len + 1;
+}
+
+static size_t next32(const void *src, size_t len, size_t pos)
+{
+    return ucdn_next_grapheme((const uint32_t *)src, len, pos);
+}
+
+static size_t next16(const void *src, size_t len, size_t pos)
+{
+    return ucdn_next_grapheme_utf16((const uint16_t *)src, len, pos);
+}
+
+static size_t next8(const void *src, size_t len, size_t pos)
+{
+    return ucdn_next_grapheme_utf8((const uint8_t *)src, len, pos);
+}
+
+/*
+ * Check that segmenting src, passed in chunks of chunk code units,
+ * reports exactly the expected boundaries.
+ */
+static int check_segmenter(const Case *c, const size_t *offsets,
+                           const void *src, size_t len, size_t size,
+                           size_t chunk)
+{
+    UCDNSegmenter s;
+    size_t found[2 * MAX_LEN + 3], pos = 0, n = 0, i, j = 1, step;
+    const char *bytes = (const char *)src;
+
+    ucdn_segmenter_init(&s, type);
+    while (pos < len) {
+        step = len - pos < chunk ? len - pos : chunk;
+        if (size == 4)
+            n += ucdn_segmenter_put(&s, (const uint32_t *)(bytes + pos * 4),
+                                    step, found + n);
+        else if (size == 2)
+            n += ucdn_segmenter_put_utf16(&s,
+                (const uint16_t *)(bytes + pos * 2), step, found + n);
+        else
+            n += ucdn_segmenter_put_utf8(&s, (const uint8_t *)bytes + pos,
+                                         step, found + n);
+        pos += step;
+    }
+    n += ucdn_segmenter_finish(&s, found + n);
+
+    for (i = 0; i < n; i++, j++) {
+        while (j < c->len && !c->boundary[j])
+            j++;
+        if (j > c->len || found[i] != offsets[j])
+            return 0;
+    }
+    return j == c->len + 1;
+}
+
+static void check_stream(const Case *c)
+{
+    uint16_t in16[2 * MAX_LEN];
+    uint8_t in8[4 * MAX_LEN];
+    size_t offsets[MAX_LEN + 1], offsets16[MAX_LEN + 1];
+    size_t offsets8[MAX_LEN + 1], i, len16, len8;
+
+    for (i = 0; i <= c->len; i++)
+        offsets[i] = i;
+    len16 = to_utf16(c, in16, offsets16);
+    len8 = to_utf8(c, in8, offsets8);
+
+    /* in one chunk, and in chunks of sizes varying by line */
+    if (!check_segmenter(c, offsets, c->code, c->len, 4, c->len) ||
+            !check_segmenter(c, offsets, c->code, c->len, 4,
+                             1 + line_no % 3)) {
+        printf("line %lu: boundary mismatch (UTF-32)\n", line_no);
+        failures++;
+    } else if (!check_segmenter(c, offsets16, in16, len16, 2,
+                                1 + line_no % 4)) {
+        printf("line %lu: boundary mismatch (UTF-16)\n", line_no);
+        failures++;
+    } else if (!check_segmenter(c, offsets8, in8, len8, 1,
+                                1 + line_no % 5)) {
+        printf("line %lu: boundary mismatch (UTF-8)\n", line_no);
+        failures++;
+    }
+}
+
+static void check(const Case *c)
+{
+    uint16_t in16[2 * MAX_LEN];
+    uint8_t in8[4 * MAX_LEN];
+    size_t offsets[MAX_LEN + 1], offsets16[MAX_LEN + 1];
+    size_t offsets8[MAX_LEN + 1], i, len16, len8, count = 0;
+
+    for (i = 0; i < c->len; i++) {
+        offsets[i] = i;
+        count += c->boundary[i];
+    }
+    offsets[i] = i;
+    len16 = to_utf16(c, in16, offsets16);
+    len8 = to_utf8(c, in8, offsets8);
+
+    if (!check_offsets(c, offsets, c->len, next32, c->code)) {
+        printf("line %lu: boundary mismatch (UTF-32)\n", line_no);
+        failures++;
+    } else if (!check_offsets(c, offsets16, len16, next16, in16)) {
+        printf("line %lu: boundary mismatch (UTF-16)\n", line_no);
+        failures++;
+    } else if (!check_offsets(c, offsets8, len8, next8, in8)) {
+        printf("line %lu: boundary mismatch (UTF-8)\n", line_no);
+        failures++;
+    } else if (ucdn_count_graphemes(c->code, c->len) != count ||
+               ucdn_count_graphemes_utf16(in16, len16) != count ||
+               ucdn_count_graphemes_utf8(in8, len8) != count) {
+        printf("line %lu: count mismatch\n", line_no);
+        failures++;
+    }
+}
+
+/* check that there is a line break opportunity exactly at the boundaries */
+static int check_breaks(const Case *c, const uint8_t *breaks)
+{
+    size_t i;
+
+    for (i = 0; i < c->len; i++) {
+        if ((breaks[i] != UCDN_LINEBREAK_NONE) != c->boundary[i + 1])
+            return 0;
+    }
+    return 1;
+}
+
+/*
+ * Check the line breaks of the whole text, and that updating the breaks
+ * after inserting or removing a codepoint anywhere gives the same result.
+ */
+static void check_lines(const Case *c)
+{
+    uint32_t edited[MAX_LEN + 1];
+    uint8_t breaks[MAX_LEN + 1];
+    size_t i, n = c->len;
+
+    ucdn_linebreaks(c->code, breaks, n);
+    if (!check_breaks(c, breaks)) {
+        printf("line %lu: break mismatch\n", line_no);
+        failures++;
+        return;
+    }
+
+    for (i = 0; i < n; i++) {
+        /* insert code[i] into the text without it */
+        memcpy(edited, c->code, i * sizeof(uint32_t));
+        memcpy(edited + i, c->code + i + 1, (n - i - 1) * sizeof(uint32_t));
+        ucdn_linebreaks(edited, breaks, n - 1);
+        memmove(breaks + i + 1, breaks + i, n - i - 1);
+        breaks[i] = UCDN_LINEBREAK_NONE;
+        ucdn_linebreaks_update(c->code, breaks, n, i, i + 1);
+        if (!check_breaks(c, breaks)) {
+            printf("line %lu: update mismatch (insertion at %lu)\n",
+                   line_no, (unsigned long)i);
+            failures++;
+            return;
+        }
+
+        /* remove a second copy of code[i] following it */
+        memcpy(edited, c->code, (i + 1) * sizeof(uint32_t));
+        memcpy(edited + i + 1, c->code + i, (n - i) * sizeof(uint32_t));
+        ucdn_linebreaks(edited, breaks, n + 1);
+        memmove(breaks + i + 1, breaks + i + 2, n - i - 1);
+        ucdn_linebreaks_update(c->code, breaks, n, i + 1, i + 1);
+        if (!check_breaks(c, breaks)) {
+            printf("line %lu: update mismatch (removal at %lu)\n",
+                   line_no, (unsigned long)(i + 1));
+            failures++;
+            return;
+        }
+    }
+}
+
+/*
+ * parse "÷ 0020 × 0308 ÷", with the operators in UTF-8. Line break tests
+ * start with "×", there is no break at the start of text.
+ */
+static int parse_case(char *p, Case *c)
+{
+    char *end;
+
+    c->len = 0;
+    for (;;) {
+        while (*p == ' ' || *p == '\t')
+            p++;
+        if (strncmp(p, "\xc3\xb7", 2) == 0) {
+            c->boundary[c->len] = 1;
+        } else if (strncmp(p, "\xc3\x97", 2) == 0) {
+            c->boundary[c->len] = 0;
+        } else {
+            return 0;
+        }
+        p += 2;
+        while (*p == ' ' || *p == '\t')
+            p++;
+        if (*p == '#' || *p == '\n' || *p == '\r' || *p == '\0')
+            return c->len > 0 && (c->boundary[0] || type == LINE) &&
+                c->boundary[c->len];
+        if (c->len == MAX_LEN)
+            return 0;
+        c->code[c->len++] = (uint32_t)strtoul(p, &end, 16);
+        if (end == p)
+            return 0;
+        p = end;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const char *filename = argc > 1 ? argv[1] : "GraphemeBreakTest.txt";
+    char buf[4096];
+    unsigned long tests = 0;
+    Case c;
+    FILE *f;
+
+    f = fopen(filename, "r");
+    if (f == NULL) {
+        printf("cannot open %s\n", filename);
+        return EXIT_FAILURE;
+    }
+    if (strstr(filename, "WordBreak"))
+        type = UCDN_SEGMENT_WORD;
+    else if (strstr(filename, "SentenceBreak"))
+        type = UCDN_SEGMENT_SENTENCE;
+    else if (strstr(filename, "LineBreak"))
+        type = LINE;
+
+    while (fgets(buf, sizeof(buf), f)) {
+        line_no++;
+        if (buf[0] == '#' || buf[0] == '\n')
+            continue;
+        if (!parse_case(buf, &c)) {
+            printf("line %lu: parse error\n", line_no);
+            return EXIT_FAILURE;
+        }
+        if (type == GRAPHEME)
+            check(&c);
+        else if (type == LINE)
+            check_lines(&c);
+        else
+            check_stream(&c);
+        tests++;
+    }
+    fclose(f);
+
+    printf("%lu test lines, %d failures\n", tests, failures);
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -412,6 +412,27 @@ START_TEST(test_decompose_special)
 }
 END_TEST
 
+START_TEST(test_decompose_full)
+{
+    int ret;
+    uint32_t decomp[4];
+
+    ret = ucdn_canonical_decompose_full(0x0041, decomp); ck_assert(ret == 0); /* no decomposition */
+    ret = ucdn_canonical_decompose_full(0x00c4, decomp); ck_assert(ret == 2 && decomp[0] == 0x0041 && decomp[1] == 0x0308);
+    ret = ucdn_canonical_decompose_full(0x01de, decomp); /* recursive */
+    ck_assert(ret == 3 && decomp[0] == 0x0041 && decomp[1] == 0x0308 && decomp[2] == 0x0304);
+    ret = ucdn_canonical_decompose_full(0x1f82, decomp); /* four codepoints */
+    ck_assert(ret == 4 && decomp[0] == 0x03b1 && decomp[1] == 0x0313 && decomp[2] == 0x0300 && decomp[3] == 0x0345);
+    ret = ucdn_canonical_decompose_full(0x212b, decomp); /* singleton */
+    ck_assert(ret == 2 && decomp[0] == 0x0041 && decomp[1] == 0x030a);
+    ret = ucdn_canonical_decompose_full(0xfb01, decomp); ck_assert(ret == 0); /* compatibility only */
+    ret = ucdn_canonical_decompose_full(0xac01, decomp); /* Hangul LVT */
+    ck_assert(ret == 3 && decomp[0] == 0x1100 && decomp[1] == 0x1161 && decomp[2] == 0x11a8);
+    ret = ucdn_canonical_decompose_full(0x1109a, decomp); ck_assert(ret == 2 && decomp[0] == 0x11099 && decomp[1] == 0x110ba);
+    ret = ucdn_canonical_decompose_full(0x200000, decomp); ck_assert(ret == 0); /* outside Unicode */
+}
+END_TEST
+
 START_TEST(test_compose_basic)
 {
     int ret;
@@ -421,6 +442,7 @@ START_TEST(test_compose_basic)
     ret = ucdn_compose(&a, 0x0066, 0x0069); ck_assert(ret == 0); /* compatibility decomposition => no recomposition */
     ret = ucdn_compose(&a, 0x0028, 0x0028); ck_assert(ret == 0); /* no composition exists */
     ret = ucdn_compose(&a, 0x200000, 0x0028); ck_assert(ret == 0); /* outside Unicode */
+    ret = ucdn_compose(&a, 0x115b8, 0x115af); ck_assert(ret == 1 && a == 0x115ba); /* SMP, Siddham */
 
     /* multi-part sequence */
     ret = ucdn_compose(&a, 0x0041, 0x0308);
@@ -438,6 +460,8 @@ START_TEST(test_compose_hangul)
     ret = ucdn_compose(&a, 0xac00, 0x11a8); ck_assert(ret == 1 && a == 0xac01); /* normal case (LV,T) */
     ret = ucdn_compose(&a, 0x1100, 0x1161); ck_assert(ret == 1 && a == 0xac00); /* normal case (L,V) */
     ret = ucdn_compose(&a, 0xd788, 0x11a3); ck_assert(ret == 0); /* invalid Jamo combination (LV,T with invalid T) */
+    ret = ucdn_compose(&a, 0xac01, 0x11a8); ck_assert(ret == 0); /* LVT syllable does not take another T */
+    ret = ucdn_compose(&a, 0xac00, 0x11a7); ck_assert(ret == 0); /* TBASE itself is not a trailing consonant */
 }
 END_TEST
 
@@ -455,6 +479,500 @@ START_TEST(test_compose_special)
 }
 END_TEST
 
+START_TEST(test_canonical_reorder)
+{
+    /* A, diaeresis (230), dot below (220), B, acute (230), grave (230) */
+    static const uint32_t src[] = {0x0041, 0x0308, 0x0323, 0x0042, 0x0301, 0x0300};
+    static const uint32_t ordered[] = {0x0041, 0x0323, 0x0308, 0x0042, 0x0301, 0x0300};
+    static const uint8_t classes[] = {0, 220, 230, 0, 230, 230};
+    uint32_t marks[40], out[40];
+    uint8_t ccc[40];
+    int i;
+
+    ucdn_canonical_reorder(src, 6, out, ccc);
+    ck_assert(memcmp(out, ordered, sizeof(ordered)) == 0);
+    ck_assert(memcmp(ccc, classes, sizeof(classes)) == 0);
+
+    /* long run: hook below (202) between acute and diaeresis (230), stays stable */
+    for (i = 0; i < 40; i++)
+        marks[i] = i % 2 ? 0x0321 : (i % 4 ? 0x0301 : 0x0308);
+    ucdn_canonical_reorder(marks, 40, out, ccc);
+    for (i = 0; i < 20; i++)
+        ck_assert(out[i] == 0x0321 && ccc[i] == 202);
+    for (i = 20; i < 40; i++)
+        ck_assert(out[i] == marks[2 * (i - 20)] && ccc[i] == 230);
+}
+END_TEST
+
+START_TEST(test_normalize)
+{
+    /* A, combining dot below, combining diaeresis, Hangul L V T */
+    static const uint32_t src[] = {0x0041, 0x0308, 0x0323, 0x1100, 0x1161, 0x11a8};
+    static const uint32_t nfc[] = {0x1ea0, 0x0308, 0xac01};
+    static const uint32_t nfd[] = {0x0041, 0x0323, 0x0308, 0x1100, 0x1161, 0x11a8};
+    static const uint32_t compat_src[] = {0x1e9b, 0x0323, 0xfb01, 0xac01};
+    static const uint32_t nfkc[] = {0x1e69, 0x0066, 0x0069, 0xac01};
+    static const uint32_t nfkd[] = {0x0073, 0x0323, 0x0307, 0x0066, 0x0069, 0x1100, 0x1161, 0x11a8};
+    static const uint8_t bad_utf8[] = {'a', 0xe2, 0x82, 'b', 0xc0, 0xaf};
+    static const uint8_t bad_utf8_nfc[] = {'a', 0xef, 0xbf, 0xbd, 'b',
+                                           0xef, 0xbf, 0xbd, 0xef, 0xbf, 0xbd};
+    static const uint16_t lone_surrogate[] = {0x0065, 0xd800, 0x0301};
+    static const uint8_t truncated[] = {'a', 0xf0, 0x9d, 0x85};
+    uint32_t out[16];
+    uint16_t out16[16];
+    uint8_t out8[16];
+    size_t len;
+
+    len = ucdn_normalize(UCDN_NORMALIZATION_NFC, src, 6, out, 16);
+    ck_assert(len == 3 && memcmp(out, nfc, sizeof(nfc)) == 0);
+    len = ucdn_normalize(UCDN_NORMALIZATION_NFD, src, 6, out, 16);
+    ck_assert(len == 6 && memcmp(out, nfd, sizeof(nfd)) == 0);
+
+    /* compatibility forms: long s with dot above and dot below, fi ligature, Hangul LVT */
+    len = ucdn_normalize(UCDN_NORMALIZATION_NFKC, compat_src, 4, out, 16);
+    ck_assert(len == 4 && memcmp(out, nfkc, sizeof(nfkc)) == 0);
+    len = ucdn_normalize(UCDN_NORMALIZATION_NFKD, compat_src, 4, out, 16);
+    ck_assert(len == 8 && memcmp(out, nfkd, sizeof(nfkd)) == 0);
+
+    /* truncated output still returns the required length */
+    len = ucdn_normalize(UCDN_NORMALIZATION_NFD, src, 6, out, 2);
+    ck_assert(len == 6 && out[0] == 0x0041 && out[1] == 0x0323);
+    len = ucdn_normalize(UCDN_NORMALIZATION_NFC, src, 6, NULL, 0);
+    ck_assert(len == 3);
+
+    /* ill-formed input is replaced by U+FFFD */
+    len = ucdn_normalize_utf8(UCDN_NORMALIZATION_NFC, bad_utf8, 6, out8, 16);
+    ck_assert(len == 11 && memcmp(out8, bad_utf8_nfc, 11) == 0);
+    len = ucdn_normalize_utf8(UCDN_NORMALIZATION_NFC, truncated, 4, out8, 16);
+    ck_assert(len == 4 && memcmp(out8, bad_utf8_nfc, 4) == 0);
+    len = ucdn_normalize_utf16(UCDN_NORMALIZATION_NFC, lone_surrogate, 3, out16, 16);
+    ck_assert(len == 3 && out16[0] == 0x0065 && out16[1] == 0xfffd && out16[2] == 0x0301);
+
+    /* invalid normalization form */
+    len = ucdn_normalize(42, src, 6, out, 16);
+    ck_assert(len == UCDN_NORMALIZE_ERROR);
+}
+END_TEST
+
+START_TEST(test_quick_check)
+{
+    static const uint32_t src[] = {0x0061, 0x0062, 0x0063, 0x0065, 0x0301, 0x0064};
+    static const uint8_t ascii[] = "already normalized text";
+    static const uint8_t bad_utf8[] = {'a', 'b', 0xc3, 'c'};
+    static const uint16_t lone_surrogate[] = {0x0061, 0x0062, 0xdc00};
+
+    ck_assert_int_eq(ucdn_get_quick_check(0x0041, UCDN_NORMALIZATION_NFC), UCDN_QUICK_CHECK_YES);
+    ck_assert_int_eq(ucdn_get_quick_check(0x0301, UCDN_NORMALIZATION_NFC), UCDN_QUICK_CHECK_MAYBE);
+    ck_assert_int_eq(ucdn_get_quick_check(0x0301, UCDN_NORMALIZATION_NFD), UCDN_QUICK_CHECK_YES);
+    ck_assert_int_eq(ucdn_get_quick_check(0x00c0, UCDN_NORMALIZATION_NFC), UCDN_QUICK_CHECK_YES);
+    ck_assert_int_eq(ucdn_get_quick_check(0x00c0, UCDN_NORMALIZATION_NFD), UCDN_QUICK_CHECK_NO);
+    ck_assert_int_eq(ucdn_get_quick_check(0x00a0, UCDN_NORMALIZATION_NFKC), UCDN_QUICK_CHECK_NO);
+    ck_assert_int_eq(ucdn_get_quick_check(0xac01, UCDN_NORMALIZATION_NFKD), UCDN_QUICK_CHECK_NO);
+    ck_assert_int_eq(ucdn_get_quick_check(0x0041, 42), -1);
+
+    /* the e may compose with the acute accent, so the prefix ends before it */
+    ck_assert(ucdn_normalized_prefix(UCDN_NORMALIZATION_NFC, src, 6) == 3);
+    ck_assert(ucdn_normalized_prefix(UCDN_NORMALIZATION_NFD, src, 6) == 6);
+    ck_assert(ucdn_normalized_prefix(UCDN_NORMALIZATION_NFC, src, 3) == 3);
+
+    ck_assert(ucdn_normalized_prefix_utf8(UCDN_NORMALIZATION_NFKC, ascii, sizeof(ascii) - 1) == sizeof(ascii) - 1);
+    ck_assert(ucdn_normalized_prefix_utf8(UCDN_NORMALIZATION_NFC, bad_utf8, 4) == 1);
+    ck_assert(ucdn_normalized_prefix_utf16(UCDN_NORMALIZATION_NFC, lone_surrogate, 3) == 1);
+    ck_assert(ucdn_normalized_prefix(42, src, 6) == 0);
+}
+END_TEST
+
+START_TEST(test_normalizer_stream)
+{
+    /* e, combining acute accent split between chunks, incomplete sequence at the end */
+    static const uint8_t chunk1[] = {'e', 0xcc};
+    static const uint8_t chunk2[] = {0x81, 'x', 0xe2, 0x82};
+    static const uint8_t nfc[] = {0xc3, 0xa9, 'x', 0xef, 0xbf, 0xbd};
+    static const uint32_t marks[] = {0x0041, 0x0308, 0x0323};
+    UCDNNormalizer n;
+    uint8_t out[16];
+    uint32_t out32[4];
+    size_t len = 0, consumed;
+
+    ck_assert(ucdn_normalizer_init(&n, UCDN_NORMALIZATION_NFC));
+    len += ucdn_normalizer_put_utf8(&n, chunk1, 2, &consumed, out + len, 16 - len);
+    ck_assert(consumed == 2);
+    len += ucdn_normalizer_put_utf8(&n, chunk2, 4, &consumed, out + len, 16 - len);
+    ck_assert(consumed == 4);
+    len += ucdn_normalizer_finish_utf8(&n, out + len, 16 - len);
+    ck_assert(ucdn_normalizer_finish_utf8(&n, out + len, 16 - len) == 0);
+    ck_assert(len == 6 && memcmp(out, nfc, 6) == 0);
+
+    /* output that does not fit is held back, no more input is consumed then */
+    ck_assert(ucdn_normalizer_init(&n, UCDN_NORMALIZATION_NFD));
+    ck_assert(ucdn_normalizer_put(&n, marks, 3, &consumed, out32, 1) == 0 && consumed == 3);
+    ck_assert(ucdn_normalizer_finish(&n, out32, 1) == 1 && out32[0] == 0x0041);
+    ck_assert(ucdn_normalizer_finish(&n, out32, 1) == 1 && out32[0] == 0x0323);
+    ck_assert(ucdn_normalizer_finish(&n, out32, 1) == 1 && out32[0] == 0x0308);
+    ck_assert(ucdn_normalizer_finish(&n, out32, 1) == 0);
+
+    ck_assert(!ucdn_normalizer_init(&n, 42));
+}
+END_TEST
+
+START_TEST(test_stream_safe)
+{
+    uint32_t src[300], out[320];
+    size_t i;
+
+    /* a CGJ goes before the 31st non-starter in a row */
+    src[0] = 0x0061;
+    for (i = 1; i < 41; i++)
+        src[i] = 0x0301;
+    ck_assert(ucdn_stream_safe(src, 41, out, 320) == 42);
+    ck_assert(out[30] == 0x0301 && out[31] == 0x034f && out[32] == 0x0301);
+    ck_assert(ucdn_stream_safe(src, 30, out, 320) == 30);
+
+    /* counted in NFKD: U+0344 is two non-starters, U+FF9E is one */
+    src[30] = 0x0344;
+    ck_assert(ucdn_stream_safe(src, 31, out, 320) == 32);
+    ck_assert(out[30] == 0x034f && out[31] == 0x0344);
+    src[30] = 0xff9e;
+    ck_assert(ucdn_stream_safe(src, 32, out, 320) == 33);
+    ck_assert(out[30] == 0xff9e && out[31] == 0x034f);
+
+    /* the normalizer option bounds the segment length */
+    for (i = 1; i < 300; i++)
+        src[i] = 0x0301;
+    ck_assert(ucdn_normalize(UCDN_NORMALIZATION_NFC, src, 300, out, 320) == 299);
+    ck_assert(ucdn_normalize(UCDN_NORMALIZATION_NFC | UCDN_NORMALIZATION_STREAM_SAFE, src, 300, out, 320) == 308);
+    ck_assert(out[0] == 0x00e1 && out[29] == 0x0301 && out[30] == 0x034f);
+    ck_assert(ucdn_normalized_prefix(UCDN_NORMALIZATION_NFD | UCDN_NORMALIZATION_STREAM_SAFE, src, 300) == 0);
+    ck_assert(ucdn_get_quick_check(0x0301, UCDN_NORMALIZATION_NFC | UCDN_NORMALIZATION_STREAM_SAFE) == -1);
+}
+END_TEST
+
+START_TEST(test_normalize_long_run)
+{
+    uint32_t src[602], out[610];
+    uint8_t src8[1300], out8[1300];
+    size_t i, len, len8;
+
+    /* 600 non-starters of three classes after a starter */
+    src[0] = 0x0065;
+    for (i = 0; i < 600; i++)
+        src[i + 1] = i % 3 == 0 ? 0x0301 : i % 3 == 1 ? 0x0323 : 0x0327;
+    src[601] = 0x0078;
+
+    len = ucdn_normalize(UCDN_NORMALIZATION_NFD, src, 602, out, 610);
+    ck_assert(len == 602 && out[0] == 0x0065 && out[601] == 0x0078);
+    for (i = 0; i < 200; i++)
+        ck_assert(out[i + 1] == 0x0327 && out[i + 201] == 0x0323 && out[i + 401] == 0x0301);
+
+    /* only the first cedilla composes, the rest is blocked */
+    len = ucdn_normalize(UCDN_NORMALIZATION_NFC, src, 602, out, 610);
+    ck_assert(len == 601 && out[0] == 0x0229 && out[600] == 0x0078);
+    ck_assert(out[1] == 0x0327 && out[199] == 0x0327 && out[200] == 0x0323);
+    ck_assert(out[400] == 0x0301 && out[599] == 0x0301);
+    ck_assert(ucdn_normalize(UCDN_NORMALIZATION_NFC, src, 602, out, 10) == 601);
+    ck_assert(out[0] == 0x0229 && out[9] == 0x0327);
+
+    len8 = 0;
+    for (i = 0; i < 602; i++) {
+        if (src[i] < 0x80) {
+            src8[len8++] = (uint8_t)src[i];
+        } else {
+            src8[len8++] = (uint8_t)(0xc0 | (src[i] >> 6));
+            src8[len8++] = (uint8_t)(0x80 | (src[i] & 0x3f));
+        }
+    }
+    ck_assert(ucdn_normalize_utf8(UCDN_NORMALIZATION_NFC, src8, len8, out8, 1300) == len8 - 1);
+    ck_assert(out8[0] == 0xc8 && out8[1] == 0xa9 && out8[2] == 0xcc && out8[3] == 0xa7);
+
+    /* the run starts and ends within the decomposition of a codepoint */
+    src[0] = 0x1e09;
+    for (i = 1; i < 301; i++)
+        src[i] = 0x0323;
+    src[301] = 0x1e09;
+    len = ucdn_normalize(UCDN_NORMALIZATION_NFD, src, 302, out, 610);
+    ck_assert(len == 306 && out[0] == 0x0063 && out[1] == 0x0327);
+    ck_assert(out[2] == 0x0323 && out[301] == 0x0323 && out[302] == 0x0301);
+    ck_assert(out[303] == 0x0063 && out[304] == 0x0327 && out[305] == 0x0301);
+    len = ucdn_normalize(UCDN_NORMALIZATION_NFC, src, 302, out, 610);
+    ck_assert(len == 302 && out[0] == 0x1e09 && out[1] == 0x0323);
+    ck_assert(out[300] == 0x0323 && out[301] == 0x1e09);
+
+    /* NFKC_Casefold goes through the same path */
+    src[0] = 0x1e08;
+    src[301] = 0x00c7;
+    len = ucdn_casefold(UCDN_CASEFOLD_NFKC, src, 302, out, 610);
+    ck_assert(len == 302 && out[0] == 0x1e09 && out[1] == 0x0323);
+    ck_assert(out[300] == 0x0323 && out[301] == 0x00e7);
+
+    /* and so does hashing, which covers every non-starter */
+    ck_assert(ucdn_casefold_hash(UCDN_CASEFOLD_NFKC, src, 302, UCDN_CASEFOLD_HASH_INIT) ==
+              ucdn_casefold_hash(UCDN_CASEFOLD_NFKC, out, 302, UCDN_CASEFOLD_HASH_INIT));
+    src[300] = 0x0301;
+    ck_assert(ucdn_casefold_hash(UCDN_CASEFOLD_NFKC, src, 302, UCDN_CASEFOLD_HASH_INIT) !=
+              ucdn_casefold_hash(UCDN_CASEFOLD_NFKC, out, 302, UCDN_CASEFOLD_HASH_INIT));
+}
+END_TEST
+
+START_TEST(test_case_mapping)
+{
+    /* final sigma only at the end of a word, ignoring the apostrophe */
+    static const uint32_t greek[] = {0x039f, 0x03a3, 0x0020, 0x03a3, 0x039f, 0x03a3, 0x0027};
+    static const uint32_t greek_lower[] = {0x03bf, 0x03c2, 0x0020, 0x03c3, 0x03bf, 0x03c2, 0x0027};
+    static const uint8_t text[] = "Stra\xc3\x9f" "e and ASCII text";
+    static const uint8_t text_upper[] = "STRASSE AND ASCII TEXT";
+    uint32_t mapped[3], out[8];
+    uint8_t out8[32];
+
+    ck_assert(ucdn_to_upper(0x0061) == 0x0041);
+    ck_assert(ucdn_to_lower(0x0041) == 0x0061);
+    ck_assert(ucdn_to_upper(0x00df) == 0x00df);
+    ck_assert(ucdn_to_lower(0x0130) == 0x0069);
+    ck_assert(ucdn_to_title(0x01c6) == 0x01c5);
+    ck_assert(ucdn_to_upper(0x10428) == 0x10400);
+    ck_assert(ucdn_to_upper(0x0031) == 0x0031);
+    ck_assert(ucdn_to_upper(0x110000) == 0x110000);
+
+    /* full mappings */
+    ck_assert(ucdn_to_upper_full(0x00df, mapped) == 2);
+    ck_assert(mapped[0] == 0x0053 && mapped[1] == 0x0053);
+    ck_assert(ucdn_to_title_full(0xfb01, mapped) == 2);
+    ck_assert(mapped[0] == 0x0046 && mapped[1] == 0x0069);
+    ck_assert(ucdn_to_lower_full(0x0130, mapped) == 2);
+    ck_assert(mapped[0] == 0x0069 && mapped[1] == 0x0307);
+    ck_assert(ucdn_to_upper_full(0x0390, mapped) == 3);
+    ck_assert(ucdn_to_upper_full(0x0061, mapped) == 1 && mapped[0] == 0x0041);
+    /* the titlecase of U+0345 is U+0399 in SpecialCasing.txt of 12.0 */
+    ck_assert(ucdn_to_title_full(0x0345, mapped) == 1 && mapped[0] == 0x0399);
+
+    /* strings */
+    ck_assert(ucdn_lowercase(greek, 7, out, 8) == 7);
+    ck_assert(memcmp(out, greek_lower, sizeof(greek_lower)) == 0);
+    ck_assert(ucdn_uppercase_utf8(text, 22, out8, 32) == 22);
+    ck_assert(memcmp(out8, text_upper, 22) == 0);
+    ck_assert(ucdn_uppercase_utf8(text, 22, out8, 4) == 22);
+    ck_assert(memcmp(out8, text_upper, 4) == 0);
+}
+END_TEST
+
+START_TEST(test_case_folding)
+{
+    /* the kelvin sign, a ligature and a soft hyphen */
+    static const uint32_t key[] = {0x212a, 0xfb01, 0x00ad, 0x0301, 0x0045};
+    static const uint32_t key_nfkc[] = {0x006b, 0x0066, 0x00ed, 0x0065};
+    static const uint8_t text[] = "Stra\xc3\x9f" "e";
+    static const uint8_t text_folded[] = "strasse";
+    static const uint8_t upper[] = "STRASSE";
+    uint32_t mapped[18], out[8];
+    uint8_t out8[16];
+    uint32_t hash;
+
+    ck_assert(ucdn_fold_case(0x0041) == 0x0061);
+    ck_assert(ucdn_fold_case(0x03c2) == 0x03c3);
+    ck_assert(ucdn_fold_case(0x1e9e) == 0x00df);
+    ck_assert(ucdn_fold_case(0x0130) == 0x0130);
+    ck_assert(ucdn_fold_case(0x10400) == 0x10428);
+    ck_assert(ucdn_fold_case(0x110000) == 0x110000);
+
+    /* full foldings */
+    ck_assert(ucdn_fold_case_full(0x00df, mapped) == 2);
+    ck_assert(mapped[0] == 0x0073 && mapped[1] == 0x0073);
+    ck_assert(ucdn_fold_case_full(0x1e9e, mapped) == 2);
+    ck_assert(mapped[0] == 0x0073 && mapped[1] == 0x0073);
+    ck_assert(ucdn_fold_case_full(0x0130, mapped) == 2);
+    ck_assert(mapped[0] == 0x0069 && mapped[1] == 0x0307);
+    ck_assert(ucdn_fold_case_full(0x0061, mapped) == 1 && mapped[0] == 0x0061);
+
+    /* NFKC_Casefold */
+    ck_assert(ucdn_nfkc_casefold(0x2126, mapped) == 1 && mapped[0] == 0x03c9);
+    ck_assert(ucdn_nfkc_casefold(0x00ad, mapped) == 0);
+    ck_assert(ucdn_nfkc_casefold(0xfdfa, mapped) == 18);
+    ck_assert(ucdn_nfkc_casefold(0x0061, mapped) == 1 && mapped[0] == 0x0061);
+    /* unassigned in Unicode 12.0, so not yet default ignorable */
+    ck_assert(ucdn_nfkc_casefold(0x180f, mapped) == 1 && mapped[0] == 0x180f);
+
+    /* strings */
+    ck_assert(ucdn_casefold_utf8(UCDN_CASEFOLD_FULL, text, 7, out8, 16) == 7);
+    ck_assert(memcmp(out8, text_folded, 7) == 0);
+    ck_assert(ucdn_casefold_utf8(UCDN_CASEFOLD_SIMPLE, text, 7, out8, 16) == 7);
+    ck_assert(memcmp(out8, "stra\xc3\x9f" "e", 7) == 0);
+    ck_assert(ucdn_casefold(UCDN_CASEFOLD_NFKC, key, 5, out, 8) == 4);
+    ck_assert(memcmp(out, key_nfkc, sizeof(key_nfkc)) == 0);
+    ck_assert(ucdn_casefold(3, key, 5, out, 8) == UCDN_NORMALIZE_ERROR);
+
+    /* hashing, in one piece and in chunks */
+    hash = ucdn_casefold_hash_utf8(UCDN_CASEFOLD_FULL, upper, 7,
+                                   UCDN_CASEFOLD_HASH_INIT);
+    ck_assert(ucdn_casefold_hash_utf8(UCDN_CASEFOLD_FULL, text, 7,
+                                      UCDN_CASEFOLD_HASH_INIT) == hash);
+    ck_assert(ucdn_casefold_hash_utf8(UCDN_CASEFOLD_FULL, text + 4, 3,
+        ucdn_casefold_hash_utf8(UCDN_CASEFOLD_FULL, text, 4,
+                                UCDN_CASEFOLD_HASH_INIT)) == hash);
+    ck_assert(ucdn_casefold_hash_utf8(UCDN_CASEFOLD_SIMPLE, text, 7,
+                                      UCDN_CASEFOLD_HASH_INIT) != hash);
+    ck_assert(ucdn_casefold_hash(UCDN_CASEFOLD_NFKC, key, 5,
+                                 UCDN_CASEFOLD_HASH_INIT) ==
+              ucdn_casefold_hash(UCDN_CASEFOLD_NFKC, key_nfkc, 4,
+                                 UCDN_CASEFOLD_HASH_INIT));
+}
+END_TEST
+
+START_TEST(test_linebreaks)
+{
+    static const uint32_t words[] = {0x0061, 0x0062, 0x0020, 0x0063, 0x0064};
+    static const uint8_t words_breaks[] = {0, 0, 1, 0, 2};
+    /* CR LF is a single mandatory break */
+    static const uint32_t lines[] = {0x0061, 0x000d, 0x000a, 0x0062};
+    static const uint8_t lines_breaks[] = {0, 0, 2, 2};
+    /* no break after $ before a number in parentheses (LB25) */
+    static const uint32_t price[] = {0x0024, 0x0028, 0x0031, 0x0029, 0x0024, 0x0028, 0x0061};
+    static const uint8_t price_breaks[] = {0, 0, 0, 0, 1, 0, 2};
+    /* regional indicators pair up (LB30a) */
+    static const uint32_t flags[] = {0x1f1e6, 0x1f1e7, 0x1f1e8, 0x1f1e9, 0x1f1ea};
+    static const uint8_t flags_breaks[] = {0, 1, 0, 1, 2};
+    /* break after ZW and spaces (LB8), but not before CL after WJ and spaces (LB13) */
+    static const uint32_t spaces[] = {0x200b, 0x0020, 0x0029, 0x2060, 0x0020, 0x0029};
+    static const uint8_t spaces_breaks[] = {0, 1, 0, 0, 0, 2};
+    /* Hebrew letter, hyphen (LB21a) and Latin letter, hyphen */
+    static const uint32_t hyphens[] = {0x05d0, 0x002d, 0x05d1, 0x0061, 0x002d, 0x0062};
+    static const uint8_t hyphens_breaks[] = {0, 0, 0, 0, 1, 2};
+    /* a combining mark takes the class of its base (LB9) */
+    static const uint32_t marks[] = {0x0028, 0x0301, 0x0061, 0x0020, 0x0301};
+    static const uint8_t marks_breaks[] = {0, 0, 0, 1, 2};
+    /* LB30 holds before a fullwidth parenthesis as well in Unicode 12.0 */
+    static const uint32_t parens[] = {0x0061, 0xff08, 0x0062, 0x0028, 0x0063};
+    static const uint8_t parens_breaks[] = {0, 0, 0, 0, 2};
+    uint8_t breaks[8];
+
+    ucdn_linebreaks(words, breaks, 5);
+    ck_assert(memcmp(breaks, words_breaks, 5) == 0);
+    ucdn_linebreaks(lines, breaks, 4);
+    ck_assert(memcmp(breaks, lines_breaks, 4) == 0);
+    ucdn_linebreaks(price, breaks, 7);
+    ck_assert(memcmp(breaks, price_breaks, 7) == 0);
+    ucdn_linebreaks(flags, breaks, 5);
+    ck_assert(memcmp(breaks, flags_breaks, 5) == 0);
+    ucdn_linebreaks(spaces, breaks, 6);
+    ck_assert(memcmp(breaks, spaces_breaks, 6) == 0);
+    ucdn_linebreaks(hyphens, breaks, 6);
+    ck_assert(memcmp(breaks, hyphens_breaks, 6) == 0);
+    ucdn_linebreaks(marks, breaks, 5);
+    ck_assert(memcmp(breaks, marks_breaks, 5) == 0);
+    ucdn_linebreaks(parens, breaks, 5);
+    ck_assert(memcmp(breaks, parens_breaks, 5) == 0);
+}
+END_TEST
+
+START_TEST(test_linebreaks_update)
+{
+    /* "ab cd ef" edited to "ab c-xd ef" */
+    static const uint32_t text[] = {0x0061, 0x0062, 0x0020, 0x0063, 0x002d, 0x0078, 0x0064, 0x0020, 0x0065, 0x0066};
+    static const uint8_t old_breaks[] = {0, 0, 1, 0, 0, 0, 0, 1, 0, 2};
+    static const uint8_t new_breaks[] = {0, 0, 1, 0, 1, 0, 0, 1, 0, 2};
+    /* "$(a" edited to "$(1", the break after $ goes away */
+    static const uint32_t price[] = {0x0024, 0x0028, 0x0031};
+    static const uint8_t price_old[] = {1, 0, 2};
+    static const uint8_t price_new[] = {0, 0, 2};
+    uint8_t breaks[10];
+
+    memcpy(breaks, old_breaks, 10);
+    ck_assert(ucdn_linebreaks_update(text, breaks, 10, 4, 6) == 7);
+    ck_assert(memcmp(breaks, new_breaks, 10) == 0);
+
+    memcpy(breaks, price_old, 3);
+    ck_assert(ucdn_linebreaks_update(price, breaks, 3, 2, 3) == 3);
+    ck_assert(memcmp(breaks, price_new, 3) == 0);
+}
+END_TEST
+
+START_TEST(test_graphemes)
+{
+    /* "e\u0301", CR LF, flag, family emoji, Hangul syllable "han" */
+    static const uint32_t text[] = {0x0065, 0x0301, 0x000d, 0x000a, 0x1f1e9, 0x1f1ea, 0x1f1eb, 0x1f468, 0x200d, 0x1f469, 0x1100, 0x1161, 0x11ab, 0x0061};
+    static const size_t ends[] = {2, 4, 6, 7, 10, 13, 14};
+    /* the same text in UTF-8 */
+    static const uint8_t text8[] = "e\xcc\x81\r\n\xf0\x9f\x87\xa9\xf0\x9f\x87\xaa"
+        "\xf0\x9f\x87\xab\xf0\x9f\x91\xa8\xe2\x80\x8d\xf0\x9f\x91\xa9"
+        "\xe1\x84\x80\xe1\x85\xa1\xe1\x86\xab" "a";
+    static const uint16_t ascii16[] = {'a', 'b', 'c', 'd', 'e', 'f', 'g', '\r', '\n', 'h', 0x0308};
+    size_t i, pos = 0;
+
+    ck_assert_int_eq(ucdn_get_grapheme_break(0x000d), UCDN_GRAPHEME_BREAK_CR);
+    ck_assert_int_eq(ucdn_get_grapheme_break(0x0301), UCDN_GRAPHEME_BREAK_EXTEND);
+    ck_assert_int_eq(ucdn_get_grapheme_break(0x0600), UCDN_GRAPHEME_BREAK_PREPEND);
+    ck_assert_int_eq(ucdn_get_grapheme_break(0xac01), UCDN_GRAPHEME_BREAK_LVT);
+    ck_assert_int_eq(ucdn_get_grapheme_break(0xe0080), UCDN_GRAPHEME_BREAK_CONTROL);
+    ck_assert_int_eq(ucdn_get_extended_pictographic(0x00a9), 1);
+    ck_assert_int_eq(ucdn_get_extended_pictographic(0x1fffd), 1);
+    ck_assert_int_eq(ucdn_get_extended_pictographic(0x0023), 0);
+    /* Unicode 12.0 values, changed by later versions */
+    ck_assert_int_eq(ucdn_get_grapheme_break(0x1734), UCDN_GRAPHEME_BREAK_EXTEND);
+    ck_assert_int_eq(ucdn_get_grapheme_break(0x11720), UCDN_GRAPHEME_BREAK_SPACINGMARK);
+    ck_assert_int_eq(ucdn_get_extended_pictographic(0x1fb00), 1);
+
+    for (i = 0; i < sizeof(ends) / sizeof(ends[0]); i++) {
+        pos = ucdn_next_grapheme(text, 14, pos);
+        ck_assert_int_eq(pos, ends[i]);
+    }
+    ck_assert_int_eq(ucdn_next_grapheme(text, 14, 14), 14);
+    ck_assert_int_eq(ucdn_next_grapheme_utf8(text8, sizeof(text8) - 1, 0), 3);
+    ck_assert_int_eq(ucdn_next_grapheme_utf8(text8, sizeof(text8) - 1, 5), 13);
+
+    ck_assert_int_eq(ucdn_count_graphemes(text, 14), 7);
+    ck_assert_int_eq(ucdn_count_graphemes_utf8(text8, sizeof(text8) - 1), 7);
+    ck_assert_int_eq(ucdn_count_graphemes(text, 0), 0);
+    /* CR LF inside an ASCII block, combining mark after one */
+    ck_assert_int_eq(ucdn_count_graphemes_utf16(ascii16, 11), 9);
+}
+END_TEST
+
+START_TEST(test_segmenter)
+{
+    static const uint8_t words[] = "can't stop 3.14.";
+    static const size_t word_ends[] = {5, 6, 10, 11, 15, 16};
+    static const uint8_t sentences[] = "He left. She said 3.5 is fine! Ok";
+    static const size_t sentence_ends[] = {9, 31, 33};
+    /* SB8, "etc. (and" does not end a sentence */
+    static const uint32_t etc[] = {'e', 't', 'c', '.', ' ', '(', 'a', 'n', 'd'};
+    UCDNSegmenter seg;
+    size_t found[40], n = 0, i;
+
+    ck_assert_int_eq(ucdn_get_word_break(0x0027), UCDN_WORD_BREAK_SINGLE_QUOTE);
+    ck_assert_int_eq(ucdn_get_word_break(0x05d0), UCDN_WORD_BREAK_HEBREW_LETTER);
+    ck_assert_int_eq(ucdn_get_word_break(0x30a2), UCDN_WORD_BREAK_KATAKANA);
+    /* ALetter and Numeric only since Unicode 14 */
+    ck_assert_int_eq(ucdn_get_word_break(0x02c2), UCDN_WORD_BREAK_OTHER);
+    ck_assert_int_eq(ucdn_get_word_break(0x05f3), UCDN_WORD_BREAK_OTHER);
+    ck_assert_int_eq(ucdn_get_word_break(0xff10), UCDN_WORD_BREAK_OTHER);
+    ck_assert_int_eq(ucdn_get_sentence_break(0x002e), UCDN_SENTENCE_BREAK_ATERM);
+    ck_assert_int_eq(ucdn_get_sentence_break(0x0021), UCDN_SENTENCE_BREAK_STERM);
+    ck_assert_int_eq(ucdn_get_sentence_break(0x2029), UCDN_SENTENCE_BREAK_SEP);
+    ck_assert_int_eq(ucdn_segmenter_init(&seg, 2), 0);
+
+    /* the boundary before the last full stop waits for the end */
+    ck_assert_int_eq(ucdn_segmenter_init(&seg, UCDN_SEGMENT_WORD), 1);
+    for (i = 0; i < sizeof(words) - 1; i++)
+        n += ucdn_segmenter_put_utf8(&seg, words + i, 1, found + n);
+    ck_assert_int_eq(n, 4);
+    n += ucdn_segmenter_finish(&seg, found + n);
+    ck_assert_int_eq(n, 6);
+    ck_assert(memcmp(found, word_ends, sizeof(word_ends)) == 0);
+
+    n = 0;
+    ucdn_segmenter_init(&seg, UCDN_SEGMENT_SENTENCE);
+    n += ucdn_segmenter_put_utf8(&seg, sentences, 20, found + n);
+    n += ucdn_segmenter_put_utf8(&seg, sentences + 20,
+                                 sizeof(sentences) - 21, found + n);
+    n += ucdn_segmenter_finish(&seg, found + n);
+    ck_assert_int_eq(n, 3);
+    ck_assert(memcmp(found, sentence_ends, sizeof(sentence_ends)) == 0);
+
+    ck_assert_int_eq(ucdn_segmenter_put(&seg, etc, 9, found), 0);
+    ck_assert_int_eq(ucdn_segmenter_finish(&seg, found), 1);
+    ck_assert_int_eq(found[0], 9);
+    ck_assert_int_eq(ucdn_segmenter_finish(&seg, found), 0);
+}
+END_TEST
+
 START_TEST(test_mirror)
 {
     /* normal, characters that mirror */
@@ -483,12 +1001,16 @@ START_TEST(test_mirror)
 
     /* special cases */
     ck_assert_int_eq(ucdn_mirror(0x200000), 0x200000); /* outside Unicode */
+    ck_assert_int_eq(ucdn_mirror(0x10028), 0x10028); /* not U+0028 */
+    ck_assert_int_eq(ucdn_get_mirrored(0x10028), 0);
 
 }
 END_TEST
 
 START_TEST(test_bidi_bracket)
 {
+    uint32_t pair;
+
     ck_assert_int_eq(ucdn_paired_bracket(0x0028), 0x0029); /* normal case */
     ck_assert_int_eq(ucdn_paired_bracket(0xff08), 0xff09); /* normal case */
     ck_assert_int_eq(ucdn_paired_bracket(0x00ab), 0x00ab); /* mirrored, but not a bracket */
@@ -498,6 +1020,59 @@ START_TEST(test_bidi_bracket)
     ck_assert_int_eq(ucdn_paired_bracket_type(0x0029), UCDN_BIDI_PAIRED_BRACKET_TYPE_CLOSE); /* normal case */
     ck_assert_int_eq(ucdn_paired_bracket_type(0x0020), UCDN_BIDI_PAIRED_BRACKET_TYPE_NONE); /* normal case */
     ck_assert_int_eq(ucdn_paired_bracket_type(0x200000), UCDN_BIDI_PAIRED_BRACKET_TYPE_NONE); /* outside Unicode */
+
+    ck_assert_int_eq(ucdn_get_bracket_pair(0x0029, &pair), UCDN_BIDI_PAIRED_BRACKET_TYPE_CLOSE); /* normal case */
+    ck_assert_int_eq(pair, 0x0028);
+    ck_assert_int_eq(ucdn_get_bracket_pair(0x10028, &pair), UCDN_BIDI_PAIRED_BRACKET_TYPE_NONE); /* outside BMP */
+    ck_assert_int_eq(pair, 0x10028);
+}
+END_TEST
+
+START_TEST(test_bidi)
+{
+    static const uint32_t latin[] = {'a', ' ', '1', '!'};
+    static const uint32_t mixed[] = {'a', ' ', 0x05d0, 0x05d1, ' ', '1', '2'};
+    static const uint8_t mixed_levels[] = {0, 0, 1, 1, 1, 2, 2};
+    static const size_t mixed_order[] = {0, 1, 5, 6, 4, 3, 2};
+    static const uint32_t isolate[] = {'a', 0x2067, 'b', 0x2069};
+    static const uint8_t isolate_levels[] = {0, 0, 2, 0};
+    /* N0, the mark after a bracket takes the class of the pair */
+    static const uint32_t brackets[] = {'a', '(', 'b', ')', 0x0331};
+    static const uint32_t line[] = {'a', ' ', 'b'};
+    size_t scratch[UCDN_BIDI_SCRATCH_LEN(8)], order[8], i;
+    uint8_t levels[8];
+
+    ck_assert_int_eq(ucdn_bidi_resolve(3, latin, 4, levels, scratch), -1);
+    ck_assert_int_eq(ucdn_bidi_resolve(UCDN_BIDI_DIRECTION_AUTO, latin, 4,
+                                       levels, scratch), 0);
+    for (i = 0; i < 4; i++)
+        ck_assert_int_eq(levels[i], 0);
+    ck_assert_int_eq(ucdn_bidi_resolve(UCDN_BIDI_DIRECTION_RTL, latin, 4,
+                                       levels, scratch), 1);
+    ck_assert_int_eq(levels[2], 2);
+    ck_assert_int_eq(levels[3], 1);
+
+    ck_assert_int_eq(ucdn_bidi_resolve(UCDN_BIDI_DIRECTION_LTR, mixed, 7,
+                                       levels, scratch), 0);
+    ck_assert(memcmp(levels, mixed_levels, 7) == 0);
+    ucdn_bidi_reorder(levels, 7, order);
+    ck_assert(memcmp(order, mixed_order, sizeof(mixed_order)) == 0);
+    ck_assert_int_eq(ucdn_bidi_resolve(UCDN_BIDI_DIRECTION_AUTO, mixed + 2, 5,
+                                       levels, scratch), 1);
+
+    ucdn_bidi_resolve(UCDN_BIDI_DIRECTION_LTR, isolate, 4, levels, scratch);
+    ck_assert(memcmp(levels, isolate_levels, 4) == 0);
+
+    ucdn_bidi_resolve(UCDN_BIDI_DIRECTION_RTL, brackets, 5, levels, scratch);
+    for (i = 0; i < 5; i++)
+        ck_assert_int_eq(levels[i], 2);
+
+    /* the space ends the first line when broken after it */
+    ucdn_bidi_resolve(UCDN_BIDI_DIRECTION_RTL, line, 3, levels, scratch);
+    ck_assert_int_eq(levels[1], 2);
+    ucdn_bidi_line_levels(line, levels, 2, 1);
+    ck_assert_int_eq(levels[0], 2);
+    ck_assert_int_eq(levels[1], 1);
 }
 END_TEST
 
@@ -541,6 +1116,47 @@ START_TEST(test_resolved_linebreak_class)
 }
 END_TEST
 
+START_TEST(test_bulk)
+{
+    uint32_t code[512];
+    UCDNProperties props[512];
+    int i;
+
+    /* mix of BMP, supplementary planes and invalid codepoints */
+    for (i = 0; i < 512; i++)
+        code[i] = (uint32_t)i * 0x1123 + (i & 1 ? 0 : 0x300);
+    code[510] = 0xffffffff;
+    code[511] = 0x200000;
+
+    ucdn_get_properties(code, props, 512);
+    for (i = 0; i < 512; i++) {
+        ck_assert_int_eq(props[i].category, ucdn_get_general_category(code[i]));
+        ck_assert_int_eq(props[i].combining, ucdn_get_combining_class(code[i]));
+        ck_assert_int_eq(props[i].bidi_class, ucdn_get_bidi_class(code[i]));
+        ck_assert_int_eq(props[i].east_asian_width, ucdn_get_east_asian_width(code[i]));
+        ck_assert_int_eq(props[i].script, ucdn_get_script(code[i]));
+        ck_assert_int_eq(props[i].linebreak_class, ucdn_get_linebreak_class(code[i]));
+    }
+
+    /* Latin-1 only input takes the direct lookup */
+    for (i = 0; i < 256; i++)
+        code[i] = (uint32_t)i;
+    ucdn_get_properties(code, props, 256);
+    ck_assert_int_eq(props[0x00].category, UCDN_GENERAL_CATEGORY_CC);
+    ck_assert_int_eq(props[0x20].category, UCDN_GENERAL_CATEGORY_ZS);
+    ck_assert_int_eq(props[0x41].category, UCDN_GENERAL_CATEGORY_LU);
+    ck_assert_int_eq(props[0xad].category, UCDN_GENERAL_CATEGORY_CF);
+    ck_assert_int_eq(props[0xe9].category, UCDN_GENERAL_CATEGORY_LL);
+    ck_assert_int_eq(props[0xe9].script, UCDN_SCRIPT_LATIN);
+    ck_assert_int_eq(props[0xa0].linebreak_class, UCDN_LINEBREAK_CLASS_GL);
+
+    /* empty input must not touch the output */
+    props[0].script = 0xff;
+    ucdn_get_properties(code, props, 0);
+    ck_assert_int_eq(props[0].script, 0xff);
+}
+END_TEST
+
 int main(int argc, char **argv)
 {
     SRunner *sr;
@@ -557,13 +1173,28 @@ int main(int argc, char **argv)
     tcase_add_test(t, test_decompose_hangul);
     tcase_add_test(t, test_decompose_compat);
     tcase_add_test(t, test_decompose_special);
+    tcase_add_test(t, test_decompose_full);
     tcase_add_test(t, test_compose_basic);
     tcase_add_test(t, test_compose_hangul);
     tcase_add_test(t, test_compose_special);
+    tcase_add_test(t, test_canonical_reorder);
+    tcase_add_test(t, test_normalize);
+    tcase_add_test(t, test_quick_check);
+    tcase_add_test(t, test_normalizer_stream);
+    tcase_add_test(t, test_stream_safe);
+    tcase_add_test(t, test_normalize_long_run);
+    tcase_add_test(t, test_case_mapping);
+    tcase_add_test(t, test_case_folding);
     tcase_add_test(t, test_mirror);
     tcase_add_test(t, test_bidi_bracket);
+    tcase_add_test(t, test_bidi);
     tcase_add_test(t, test_linebreak_class);
     tcase_add_test(t, test_resolved_linebreak_class);
+    tcase_add_test(t, test_linebreaks);
+    tcase_add_test(t, test_linebreaks_update);
+    tcase_add_test(t, test_graphemes);
+    tcase_add_test(t, test_segmenter);
+    tcase_add_test(t, test_bulk);
     suite_add_tcase(s, t);
     
     sr = srunner_create(s);
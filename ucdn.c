@@ -17,16 +17,28 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <stddef.h>
+#include <string.h>
 #include "ucdn.h"
 
-typedef struct {
-    unsigned char category;
-    unsigned char combining;
-    unsigned char bidi_class;
-    unsigned char east_asian_width;
-    unsigned char script;
-    unsigned char linebreak_class;
-} UCDRecord;
+#if !defined(UCDN_NO_SIMD) && (defined(__clang__) || (defined(__GNUC__) && \
+    (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)))) && \
+    (defined(__x86_64__) || defined(__i386__))
+#define UCDN_HAVE_AVX2
+#include <immintrin.h>
+#endif
+
+#ifdef UCDN_PACKED_RECORDS
+typedef uint32_t UCDRecord;
+#else
+typedef UCDNProperties UCDRecord;
+#endif
+
+#ifdef UCDN_UTF32_DECOMP
+typedef unsigned int DecompUnit;
+#else
+typedef unsigned short DecompUnit;
+#endif
 
 typedef struct {
     unsigned short from, to;
@@ -38,12 +50,32 @@ typedef struct {
 } BracketPair;
 
 typedef struct {
-    unsigned int start;
-    short count, index;
-} Reindex;
+    int lower, upper, title, fold;
+    unsigned char flags;
+    unsigned short special;
+} CaseRecord;
 
 #include "ucdn_db.h"
 
+/* access to the fields of a database record */
+#ifdef UCDN_PACKED_RECORDS
+#define PACKED_FIELD(r, name) \
+    ((*(r) >> PACKED_##name##_SHIFT) & PACKED_##name##_MASK)
+#define REC_CATEGORY(r) PACKED_FIELD(r, CATEGORY)
+#define REC_COMBINING(r) combining_values[PACKED_FIELD(r, COMBINING)]
+#define REC_BIDI_CLASS(r) PACKED_FIELD(r, BIDI)
+#define REC_EAST_ASIAN_WIDTH(r) (PACKED_FIELD(r, SCRIPT_WIDTH) % PACKED_WIDTHS)
+#define REC_SCRIPT(r) (PACKED_FIELD(r, SCRIPT_WIDTH) / PACKED_WIDTHS)
+#define REC_LINEBREAK_CLASS(r) PACKED_FIELD(r, LINEBREAK)
+#else
+#define REC_CATEGORY(r) ((r)->category)
+#define REC_COMBINING(r) ((r)->combining)
+#define REC_BIDI_CLASS(r) ((r)->bidi_class)
+#define REC_EAST_ASIAN_WIDTH(r) ((r)->east_asian_width)
+#define REC_SCRIPT(r) ((r)->script)
+#define REC_LINEBREAK_CLASS(r) ((r)->linebreak_class)
+#endif
+
 /* constants required for Hangul (de)composition */
 #define SBASE 0xAC00
 #define LBASE 0x1100
@@ -55,24 +87,238 @@ typedef struct {
 #define TCOUNT 28
 #define NCOUNT (VCOUNT * TCOUNT)
 
-static const UCDRecord *get_ucd_record(uint32_t code)
+/*
+ * The record trie has two to four stages, depending on how the database
+ * was generated. SHIFTn is the block size of stage n in bits, TRIE_SHIFTn
+ * the number of codepoint bits below stage n - 1.
+ */
+#if TRIE_STAGES == 4
+#define TRIE_SHIFT3 SHIFT3
+#define TRIE_SHIFT2 (SHIFT2+SHIFT3)
+#define TRIE_SHIFT1 (SHIFT1+SHIFT2+SHIFT3)
+#elif TRIE_STAGES == 3
+#define TRIE_SHIFT2 SHIFT2
+#define TRIE_SHIFT1 (SHIFT1+SHIFT2)
+#else
+#define TRIE_SHIFT1 SHIFT1
+#endif
+
+/* next stage entry for a block number of the previous stage */
+#define TRIE_STEP(table, index, code, shift, low) \
+    table[((index) << (shift)) + (((code) >> (low)) & ((1<<(shift)) - 1))]
+
+static int get_ucd_trie_index(uint32_t code)
 {
-    int index, offset;
+    int index;
 
-    if (code >= 0x110000)
-        index = 0;
-    else {
-        index  = index0[code >> (SHIFT1+SHIFT2)] << SHIFT1;
-        offset = (code >> SHIFT2) & ((1<<SHIFT1) - 1);
-        index  = index1[index + offset] << SHIFT2;
-        offset = code & ((1<<SHIFT2) - 1);
-        index  = index2[index + offset];
+    code -= TRIE_BASE;
+    if (code >= 0x110000 - TRIE_BASE)
+        return 0;
+
+    index = index0[code >> TRIE_SHIFT1];
+#if TRIE_STAGES == 2
+    return TRIE_STEP(index1, index, code, SHIFT1, 0);
+#elif TRIE_STAGES == 3
+    index = TRIE_STEP(index1, index, code, SHIFT1, TRIE_SHIFT2);
+    return TRIE_STEP(index2, index, code, SHIFT2, 0);
+#else
+    index = TRIE_STEP(index1, index, code, SHIFT1, TRIE_SHIFT2);
+    index = TRIE_STEP(index2, index, code, SHIFT2, TRIE_SHIFT3);
+    return TRIE_STEP(index3, index, code, SHIFT3, 0);
+#endif
+}
+
+#ifdef UCDN_FLAT_BMP
+#define DIRECT_LIMIT 0x10000
+#define direct_index bmp_index
+#else
+#define DIRECT_LIMIT 0x100
+#define direct_index latin1_index
+#endif
+
+static int get_ucd_index(uint32_t code)
+{
+    if (code < DIRECT_LIMIT)
+        return direct_index[code];
+    return get_ucd_trie_index(code);
+}
+
+#ifdef UCDN_HAVE_AVX2
+/* gather 8 table entries, zero-extended to 32 bits */
+#define GATHER(table, vindex) _mm256_and_si256( \
+    _mm256_i32gather_epi32((const int *)(table), (vindex), \
+                           sizeof((table)[0])), \
+    _mm256_set1_epi32((int)(0xffffffffu >> (32 - 8 * sizeof((table)[0])))))
+
+/*
+ * Trie walk for 8 codepoints at once using AVX2 gathers. The index tables
+ * are padded by the generator, so the 32-bit loads stay within bounds.
+ * Codepoints outside of the trie yield 0.
+ */
+#define GATHER_STEP(table, vindex, c, shift, low) GATHER(table, \
+    _mm256_add_epi32(_mm256_slli_epi32((vindex), (shift)), \
+        _mm256_and_si256(_mm256_srli_epi32((c), (low)), \
+                         _mm256_set1_epi32((1<<(shift)) - 1))))
+
+__attribute__((target("avx2")))
+static __m256i get_ucd_trie_indices_avx2(__m256i c)
+{
+    const __m256i last = _mm256_set1_epi32(0x10ffff - TRIE_BASE);
+    __m256i valid, idx;
+
+    c = _mm256_sub_epi32(c, _mm256_set1_epi32(TRIE_BASE));
+    valid = _mm256_cmpeq_epi32(_mm256_min_epu32(c, last), c);
+    c = _mm256_and_si256(c, valid);
+
+    idx = GATHER(index0, _mm256_srli_epi32(c, TRIE_SHIFT1));
+#if TRIE_STAGES == 2
+    idx = GATHER_STEP(index1, idx, c, SHIFT1, 0);
+#elif TRIE_STAGES == 3
+    idx = GATHER_STEP(index1, idx, c, SHIFT1, TRIE_SHIFT2);
+    idx = GATHER_STEP(index2, idx, c, SHIFT2, 0);
+#else
+    idx = GATHER_STEP(index1, idx, c, SHIFT1, TRIE_SHIFT2);
+    idx = GATHER_STEP(index2, idx, c, SHIFT2, TRIE_SHIFT3);
+    idx = GATHER_STEP(index3, idx, c, SHIFT3, 0);
+#endif
+    return _mm256_and_si256(idx, valid);
+}
+
+__attribute__((target("avx2")))
+static void get_ucd_indices_avx2(const uint32_t *code, uint32_t *index,
+                                 size_t len)
+{
+    const __m256i direct_mask = _mm256_set1_epi32(~(DIRECT_LIMIT - 1));
+    size_t i;
+
+    for (i = 0; i + 8 <= len; i += 8) {
+        __m256i c, idx;
+
+        c = _mm256_loadu_si256((const __m256i *)(code + i));
+
+        if (_mm256_testz_si256(c, direct_mask)) {
+            /* all in the direct index: a single lookup */
+            idx = GATHER(direct_index, c);
+        } else {
+#ifdef UCDN_FLAT_BMP
+            /* BMP and supplementary planes mixed, merge both lookups */
+            __m256i bmp = _mm256_cmpeq_epi32(
+                _mm256_andnot_si256(direct_mask, c), c);
+
+            idx = _mm256_or_si256(
+                _mm256_and_si256(GATHER(direct_index,
+                    _mm256_andnot_si256(direct_mask, c)), bmp),
+                get_ucd_trie_indices_avx2(c));
+#else
+            idx = get_ucd_trie_indices_avx2(c);
+#endif
+        }
+
+        _mm256_storeu_si256((__m256i *)(index + i), idx);
+    }
+
+    for (; i < len; i++)
+        index[i] = get_ucd_index(code[i]);
+}
+
+/*
+ * Set once when the library is loaded, so that threads never race on
+ * it. Calls from earlier constructors use the scalar lookup.
+ */
+static int have_avx2;
+
+__attribute__((constructor))
+static void detect_avx2(void)
+{
+    __builtin_cpu_init();
+    have_avx2 = __builtin_cpu_supports("avx2") ? 1 : 0;
+}
+#endif
+
+static void get_ucd_indices(const uint32_t *code, uint32_t *index, size_t len)
+{
+    uint32_t all = 0;
+    size_t i;
+
+#ifdef UCDN_HAVE_AVX2
+    if (have_avx2) {
+        get_ucd_indices_avx2(code, index, len);
+        return;
     }
+#endif
 
-    return &ucd_records[index];
+    /*
+     * Decide once for the whole chunk, a branch per codepoint is
+     * mispredicted all the time on mixed-script text.
+     */
+    for (i = 0; i < len; i++)
+        all |= code[i];
+
+    if (all < DIRECT_LIMIT) {
+        for (i = 0; i < len; i++)
+            index[i] = direct_index[code[i]];
+    } else {
+#ifdef UCDN_FLAT_BMP
+        for (i = 0; i < len; i++)
+            index[i] = get_ucd_index(code[i]);
+#else
+        for (i = 0; i < len; i++)
+            index[i] = get_ucd_trie_index(code[i]);
+#endif
+    }
+}
+
+/*
+ * Entry of a generated three-stage trie with the tables name_index0..2
+ * and the block sizes NAME_SHIFT1..2.
+ */
+#define LOOKUP3(name, NAME, code) \
+    name##_index2[(name##_index1[(name##_index0[(code) >> \
+        (NAME##_SHIFT1+NAME##_SHIFT2)] << NAME##_SHIFT1) + \
+        (((code) >> NAME##_SHIFT2) & ((1<<NAME##_SHIFT1) - 1))] \
+        << NAME##_SHIFT2) + ((code) & ((1<<NAME##_SHIFT2) - 1))]
+
+static const UCDRecord *get_ucd_record(uint32_t code)
+{
+    return &ucd_records[get_ucd_index(code)];
 }
 
-static const unsigned short *get_decomp_record(uint32_t code)
+/*
+ * Bulk lookup of a record field. The trie is walked for a chunk of
+ * codepoints at a time, vectorized if possible, and the loads of
+ * neighbouring codepoints are independent so they can overlap.
+ */
+#define BULK_CHUNK 64
+#define BULK_LOOKUP(code, out, len, expr) do { \
+    uint32_t index[BULK_CHUNK]; \
+    const UCDRecord *record; \
+    size_t i, j, n; \
+    for (i = 0; i < (len); i += n) { \
+        n = (len) - i < BULK_CHUNK ? (len) - i : BULK_CHUNK; \
+        get_ucd_indices((code) + i, index, n); \
+        for (j = 0; j < n; j++) { \
+            record = &ucd_records[index[j]]; \
+            (out)[i + j] = (expr); \
+        } \
+    } \
+} while (0)
+
+#ifdef UCDN_PROPERTY_TRIES
+/*
+ * Bulk lookup in a property trie, with expr as the value of codepoints
+ * outside of Unicode. There is no record to go through, the three loads
+ * per codepoint are all there is.
+ */
+#define BULK_LOOKUP3(name, NAME, code, out, len, expr) do { \
+    size_t i; \
+    for (i = 0; i < (len); i++) { \
+        uint32_t c = (code)[i]; \
+        (out)[i] = c < 0x110000 ? LOOKUP3(name, NAME, c) : (expr); \
+    } \
+} while (0)
+#endif
+
+static const DecompUnit *get_decomp_record(uint32_t code)
 {
     int index, offset;
 
@@ -90,55 +336,49 @@ static const unsigned short *get_decomp_record(uint32_t code)
     return &decomp_data[index];
 }
 
-static int compare_reindex(const void *a, const void *b)
+static int get_nfc_index(uint32_t code)
 {
-    Reindex *ra = (Reindex *)a;
-    Reindex *rb = (Reindex *)b;
-
-    if (ra->start < rb->start)
-        return -1;
-    else if (ra->start > (rb->start + rb->count))
-        return 1;
-    else
+    if (code >= 0x110000)
         return 0;
+    return LOOKUP3(nfc, NFC, code);
 }
 
-static int get_comp_index(uint32_t code, const Reindex *idx, size_t len)
+/* offset into full_decomp_data, 0 if there is no canonical decomposition */
+static int get_full_decomp_index(uint32_t code)
 {
-    Reindex *res;
-    Reindex r = {0, 0, 0};
-    r.start = code;
-    res = (Reindex *) bsearch(&r, idx, len, sizeof(Reindex), compare_reindex);
-
-    if (res != NULL)
-        return res->index + (code - res->start);
-    else
-        return -1;
+    if (code >= 0x110000)
+        return 0;
+    return LOOKUP3(full_decomp, FULL_DECOMP, code);
 }
 
-static int compare_mp(const void *a, const void *b)
+/* quick check values, two bits per form, and combining class << 8 */
+static int get_qc(uint32_t code)
 {
-    MirrorPair *mpa = (MirrorPair *)a;
-    MirrorPair *mpb = (MirrorPair *)b;
-    return mpa->from - mpb->from;
+    if (code >= 0x110000)
+        return 0;
+    return LOOKUP3(qc, QC, code);
 }
 
-static int compare_bp(const void *a, const void *b)
+static const CaseRecord *get_case_record(uint32_t code)
 {
-    BracketPair *bpa = (BracketPair *)a;
-    BracketPair *bpb = (BracketPair *)b;
-    return bpa->from - bpb->from;
+    if (code >= 0x110000)
+        return &case_records[0];
+    return &case_records[LOOKUP3(case, CASE, code)];
 }
 
-static BracketPair *search_bp(uint32_t code)
+/* offset into nfkc_cf_data, 0 if the codepoint maps to itself */
+static int get_nfkc_cf_index(uint32_t code)
 {
-    BracketPair bp = {0,0,2};
-    BracketPair *res;
+    if (code >= 0x110000)
+        return 0;
+    return LOOKUP3(nfkc_cf, NFKC_CF, code);
+}
 
-    bp.from = code;
-    res = (BracketPair *) bsearch(&bp, bracket_pairs, BIDI_BRACKET_LEN,
-                                 sizeof(BracketPair), compare_bp);
-    return res;
+static int get_segment_props(uint32_t code)
+{
+    if (code >= 0x110000)
+        return 0;
+    return segment_records[LOOKUP3(segment, SEGMENT, code)];
 }
 
 static int hangul_pair_decompose(uint32_t code, uint32_t *a, uint32_t *b)
@@ -163,7 +403,8 @@ static int hangul_pair_decompose(uint32_t code, uint32_t *a, uint32_t *b)
 
 static int hangul_pair_compose(uint32_t *code, uint32_t a, uint32_t b)
 {
-    if (a >= SBASE && a < (SBASE + SCOUNT) && b >= TBASE && b < (TBASE + TCOUNT)) {
+    if (a >= SBASE && a < (SBASE + SCOUNT) && (a - SBASE) % TCOUNT == 0 &&
+            b > TBASE && b < (TBASE + TCOUNT)) {
         /* LV,T */
         *code = a + (b - TBASE);
         return 3;
@@ -178,6 +419,9 @@ static int hangul_pair_compose(uint32_t *code, uint32_t a, uint32_t b)
     }
 }
 
+#ifdef UCDN_UTF32_DECOMP
+#define DECOMP_NEXT(rec) (*(rec)++)
+#else
 static uint32_t decode_utf16(const unsigned short **code_ptr)
 {
     const unsigned short *code = *code_ptr;
@@ -192,29 +436,55 @@ static uint32_t decode_utf16(const unsigned short **code_ptr)
     }
 }
 
+#define DECOMP_NEXT(rec) decode_utf16(&(rec))
+#endif
+
 const char *ucdn_get_unicode_version(void)
 {
     return UNIDATA_VERSION;
 }
 
+int ucdn_get_table_layout(void)
+{
+    int layout = 0;
+
+#ifdef UCDN_FLAT_BMP
+    layout |= UCDN_LAYOUT_FLAT_BMP;
+#endif
+#ifdef UCDN_PACKED_RECORDS
+    layout |= UCDN_LAYOUT_PACKED_RECORDS;
+#endif
+#ifdef UCDN_PROPERTY_TRIES
+    layout |= UCDN_LAYOUT_PROPERTY_TRIES;
+#endif
+#ifdef UCDN_UTF32_DECOMP
+    layout |= UCDN_LAYOUT_UTF32_DECOMP;
+#endif
+    return layout;
+}
+
 int ucdn_get_combining_class(uint32_t code)
 {
-    return get_ucd_record(code)->combining;
+    return REC_COMBINING(get_ucd_record(code));
 }
 
 int ucdn_get_east_asian_width(uint32_t code)
 {
-    return get_ucd_record(code)->east_asian_width;
+    return REC_EAST_ASIAN_WIDTH(get_ucd_record(code));
 }
 
 int ucdn_get_general_category(uint32_t code)
 {
-    return get_ucd_record(code)->category;
+    return REC_CATEGORY(get_ucd_record(code));
 }
 
 int ucdn_get_bidi_class(uint32_t code)
 {
-    return get_ucd_record(code)->bidi_class;
+#ifdef UCDN_PROPERTY_TRIES
+    if (code < 0x110000)
+        return LOOKUP3(bidi, BIDI, code);
+#endif
+    return REC_BIDI_CLASS(get_ucd_record(code));
 }
 
 int ucdn_get_mirrored(uint32_t code)
@@ -224,19 +494,25 @@ int ucdn_get_mirrored(uint32_t code)
 
 int ucdn_get_script(uint32_t code)
 {
-    return get_ucd_record(code)->script;
+#ifdef UCDN_PROPERTY_TRIES
+    if (code < 0x110000)
+        return LOOKUP3(script, SCRIPT, code);
+#endif
+    return REC_SCRIPT(get_ucd_record(code));
 }
 
 int ucdn_get_linebreak_class(uint32_t code)
 {
-    return get_ucd_record(code)->linebreak_class;
+#ifdef UCDN_PROPERTY_TRIES
+    if (code < 0x110000)
+        return LOOKUP3(linebreak, LINEBREAK, code);
+#endif
+    return REC_LINEBREAK_CLASS(get_ucd_record(code));
 }
 
-int ucdn_get_resolved_linebreak_class(uint32_t code)
+static int resolve_linebreak_class(const UCDRecord *record)
 {
-    const UCDRecord *record = get_ucd_record(code);
-
-    switch (record->linebreak_class)
+    switch (REC_LINEBREAK_CLASS(record))
     {
     case UCDN_LINEBREAK_CLASS_AI:
     case UCDN_LINEBREAK_CLASS_SG:
@@ -244,8 +520,8 @@ int ucdn_get_resolved_linebreak_class(uint32_t code)
         return UCDN_LINEBREAK_CLASS_AL;
 
     case UCDN_LINEBREAK_CLASS_SA:
-        if (record->category == UCDN_GENERAL_CATEGORY_MC ||
-                record->category == UCDN_GENERAL_CATEGORY_MN)
+        if (REC_CATEGORY(record) == UCDN_GENERAL_CATEGORY_MC ||
+                REC_CATEGORY(record) == UCDN_GENERAL_CATEGORY_MN)
             return UCDN_LINEBREAK_CLASS_CM;
         return UCDN_LINEBREAK_CLASS_AL;
 
@@ -259,46 +535,123 @@ int ucdn_get_resolved_linebreak_class(uint32_t code)
         return UCDN_LINEBREAK_CLASS_BK;
 
     default:
-        return record->linebreak_class;
+        return REC_LINEBREAK_CLASS(record);
     }
 }
 
+int ucdn_get_resolved_linebreak_class(uint32_t code)
+{
+    return resolve_linebreak_class(get_ucd_record(code));
+}
+
+/*
+ * Array getters for the properties the algorithms below need for whole
+ * texts. They are not public, ucdn_get_properties() is the array getter for
+ * callers: a single property is dominated by the table loads as much as the
+ * scalar getter is.
+ */
+static void get_combining_classes(const uint32_t *code, uint8_t *combining,
+                                  size_t len)
+{
+    BULK_LOOKUP(code, combining, len, REC_COMBINING(record));
+}
+
+static void get_bidi_classes(const uint32_t *code, uint8_t *bidi_class,
+                             size_t len)
+{
+#ifdef UCDN_PROPERTY_TRIES
+    BULK_LOOKUP3(bidi, BIDI, code, bidi_class, len,
+                 REC_BIDI_CLASS(ucd_records));
+#else
+    BULK_LOOKUP(code, bidi_class, len, REC_BIDI_CLASS(record));
+#endif
+}
+
+static void get_linebreak_classes(const uint32_t *code,
+                                  uint8_t *linebreak_class, size_t len)
+{
+#ifdef UCDN_PROPERTY_TRIES
+    BULK_LOOKUP3(linebreak, LINEBREAK, code, linebreak_class, len,
+                 REC_LINEBREAK_CLASS(ucd_records));
+#else
+    BULK_LOOKUP(code, linebreak_class, len, REC_LINEBREAK_CLASS(record));
+#endif
+}
+
+#ifdef UCDN_PACKED_RECORDS
+static UCDNProperties unpack_record(const UCDRecord *record)
+{
+    UCDNProperties props;
+    uint32_t script_width = PACKED_FIELD(record, SCRIPT_WIDTH);
+
+    props.category = (uint8_t)REC_CATEGORY(record);
+    props.combining = REC_COMBINING(record);
+    props.bidi_class = (uint8_t)REC_BIDI_CLASS(record);
+    props.east_asian_width = (uint8_t)(script_width % PACKED_WIDTHS);
+    props.script = (uint8_t)(script_width / PACKED_WIDTHS);
+    props.linebreak_class = (uint8_t)REC_LINEBREAK_CLASS(record);
+    return props;
+}
+#else
+#define unpack_record(record) (*(record))
+#endif
+
+void ucdn_get_properties(const uint32_t *code, UCDNProperties *props,
+                         size_t len)
+{
+    BULK_LOOKUP(code, props, len, unpack_record(record));
+}
+
 uint32_t ucdn_mirror(uint32_t code)
 {
-    MirrorPair mp = {0};
-    MirrorPair *res;
+    int index;
 
-    mp.from = code;
-    res = (MirrorPair *) bsearch(&mp, mirror_pairs, BIDI_MIRROR_LEN,
-                                sizeof(MirrorPair), compare_mp);
+    /* all mirrored characters are in the BMP */
+    if (code >= 0x10000)
+        return code;
 
-    if (res == NULL)
+    index = LOOKUP3(mirror, MIRROR, code);
+    if (index == 0)
         return code;
     else
-        return res->to;
+        return mirror_pairs[index - 1].to;
+}
+
+int ucdn_get_bracket_pair(uint32_t code, uint32_t *pair)
+{
+    int index = 0;
+
+    /* all bracket pairs are in the BMP */
+    if (code < 0x10000)
+        index = LOOKUP3(bracket, BRACKET, code);
+
+    if (index == 0) {
+        *pair = code;
+        return UCDN_BIDI_PAIRED_BRACKET_TYPE_NONE;
+    }
+
+    *pair = bracket_pairs[index - 1].to;
+    return bracket_pairs[index - 1].type;
 }
 
 uint32_t ucdn_paired_bracket(uint32_t code)
 {
-    BracketPair *res = search_bp(code);
-    if (res == NULL)
-        return code;
-    else
-        return res->to;
+    uint32_t pair;
+
+    ucdn_get_bracket_pair(code, &pair);
+    return pair;
 }
 
 int ucdn_paired_bracket_type(uint32_t code)
 {
-    BracketPair *res = search_bp(code);
-    if (res == NULL)
-        return UCDN_BIDI_PAIRED_BRACKET_TYPE_NONE;
-    else
-        return res->type;
+    uint32_t pair;
+
+    return ucdn_get_bracket_pair(code, &pair);
 }
 
 int ucdn_decompose(uint32_t code, uint32_t *a, uint32_t *b)
 {
-    const unsigned short *rec;
+    const DecompUnit *rec;
     int len;
 
     if (hangul_pair_decompose(code, a, b))
@@ -311,9 +664,9 @@ int ucdn_decompose(uint32_t code, uint32_t *a, uint32_t *b)
         return 0;
 
     rec++;
-    *a = decode_utf16(&rec);
+    *a = DECOMP_NEXT(rec);
     if (len > 1)
-        *b = decode_utf16(&rec);
+        *b = DECOMP_NEXT(rec);
     else
         *b = 0;
 
@@ -327,13 +680,13 @@ int ucdn_compose(uint32_t *code, uint32_t a, uint32_t b)
     if (hangul_pair_compose(code, a, b))
         return 1;
 
-    l = get_comp_index(a, nfc_first, sizeof(nfc_first) / sizeof(Reindex));
-    r = get_comp_index(b, nfc_last, sizeof(nfc_last) / sizeof(Reindex));
+    l = get_nfc_index(a) & ((1<<NFC_LAST_SHIFT) - 1);
+    r = get_nfc_index(b) >> NFC_LAST_SHIFT;
 
-    if (l < 0 || r < 0)
+    if (l == 0 || r == 0)
         return 0;
 
-    indexi = l * TOTAL_LAST + r;
+    indexi = (l - 1) * TOTAL_LAST + (r - 1);
     index  = comp_index0[indexi >> (COMP_SHIFT1+COMP_SHIFT2)] << COMP_SHIFT1;
     offset = (indexi >> COMP_SHIFT2) & ((1<<COMP_SHIFT1) - 1);
     index  = comp_index1[index + offset] << COMP_SHIFT2;
@@ -343,10 +696,40 @@ int ucdn_compose(uint32_t *code, uint32_t a, uint32_t b)
     return *code != 0;
 }
 
+int ucdn_canonical_decompose_full(uint32_t code, uint32_t *decomposed)
+{
+    const unsigned int *rec;
+    uint32_t a, b;
+    int i, len, index;
+
+    if (hangul_pair_decompose(code, &a, &b)) {
+        /* LVT syllables decompose into an LV syllable and T */
+        if (hangul_pair_decompose(a, &decomposed[0], &decomposed[1])) {
+            decomposed[2] = b;
+            return 3;
+        }
+        decomposed[0] = a;
+        decomposed[1] = b;
+        return 2;
+    }
+
+    index = get_full_decomp_index(code);
+    if (index == 0)
+        return 0;
+
+    rec = &full_decomp_data[index];
+    len = rec[0] >> 24;
+    decomposed[0] = rec[0] & 0xffffff;
+    for (i = 1; i < len; i++)
+        decomposed[i] = rec[i];
+
+    return len;
+}
+
 int ucdn_compat_decompose(uint32_t code, uint32_t *decomposed)
 {
     int i, len;
-    const unsigned short *rec = get_decomp_record(code);
+    const DecompUnit *rec = get_decomp_record(code);
     len = rec[0] >> 8;
 
     if (len == 0)
@@ -354,7 +737,3237 @@ int ucdn_compat_decompose(uint32_t code, uint32_t *decomposed)
 
     rec++;
     for (i = 0; i < len; i++)
-        decomposed[i] = decode_utf16(&rec);
+        decomposed[i] = DECOMP_NEXT(rec);
+
+    return len;
+}
+
+/*
+ * Canonical reordering
+ *
+ * Each run of non-starters is stably sorted by combining class. Short
+ * runs, which is nearly all of them in real text, are sorted by
+ * insertion. Longer runs use a counting sort over the 256 possible
+ * classes, so the time stays linear however many marks follow a
+ * starter.
+ */
+#define REORDER_COUNTING_MIN 16
+
+/*
+ * Sort a run of non-starters from src into dst, and the combining
+ * classes in ccc in place. For short runs, src and dst may be the same.
+ */
+static void reorder_run(const uint32_t *src, uint8_t *ccc, size_t len,
+                        uint32_t *dst)
+{
+    size_t count[256], i, j, pos;
+    uint32_t code;
+    uint8_t c;
+
+    if (len < REORDER_COUNTING_MIN) {
+        for (i = 0; i < len; i++) {
+            code = src[i];
+            c = ccc[i];
+            for (j = i; j > 0 && ccc[j - 1] > c; j--) {
+                dst[j] = dst[j - 1];
+                ccc[j] = ccc[j - 1];
+            }
+            dst[j] = code;
+            ccc[j] = c;
+        }
+        return;
+    }
+
+    memset(count, 0, sizeof(count));
+    for (i = 0; i < len; i++)
+        count[ccc[i]]++;
+    for (i = 0, pos = 0; i < 256; i++) {
+        j = count[i];
+        count[i] = pos;
+        pos += j;
+    }
+    for (i = 0; i < len; i++)
+        dst[count[ccc[i]]++] = src[i];
+
+    /* count[i] is now the end of class i in the sorted run */
+    for (i = 0, pos = 0; i < 256; i++) {
+        while (pos < count[i])
+            ccc[pos++] = (uint8_t)i;
+    }
+}
+
+void ucdn_canonical_reorder(const uint32_t *src, size_t len, uint32_t *dst,
+                            uint8_t *ccc)
+{
+    size_t i = 0, start;
+
+    get_combining_classes(src, ccc, len);
+    while (i < len) {
+        start = i;
+        while (i < len && ccc[i] == 0)
+            i++;
+        memcpy(dst + start, src + start, (i - start) * sizeof(uint32_t));
+
+        start = i;
+        while (i < len && ccc[i] != 0)
+            i++;
+        reorder_run(src + start, ccc + start, i - start, dst + start);
+    }
+}
+
+/*
+ * String normalization
+ *
+ * The input is decomposed codepoint by codepoint into a segment buffer
+ * that holds a starter and the non-starters following it. When the next
+ * starter arrives, the non-starters are put into canonical order, the
+ * segment is composed for NFC and then written out. For NFC, a segment
+ * that composed into a single starter is kept, so that it can compose
+ * with the next starter as well (Hangul LV + T and the like).
+ */
+
+#define ENCODING_UTF32 0
+#define ENCODING_UTF16 1
+#define ENCODING_UTF8 2
+/* internal, dst points to an FNV-1a hash of the UTF-8 output */
+#define ENCODING_HASH 3
+
+#define FNV_PRIME 16777619u
+
+/* FNV-1a step over the UTF-8 encoding of a codepoint */
+static uint32_t hash_code(uint32_t hash, uint32_t code)
+{
+    if (code < 0x80) {
+        hash = (hash ^ code) * FNV_PRIME;
+    } else if (code < 0x800) {
+        hash = (hash ^ (0xc0 | (code >> 6))) * FNV_PRIME;
+        hash = (hash ^ (0x80 | (code & 0x3f))) * FNV_PRIME;
+    } else if (code < 0x10000) {
+        hash = (hash ^ (0xe0 | (code >> 12))) * FNV_PRIME;
+        hash = (hash ^ (0x80 | ((code >> 6) & 0x3f))) * FNV_PRIME;
+        hash = (hash ^ (0x80 | (code & 0x3f))) * FNV_PRIME;
+    } else {
+        hash = (hash ^ (0xf0 | (code >> 18))) * FNV_PRIME;
+        hash = (hash ^ (0x80 | ((code >> 12) & 0x3f))) * FNV_PRIME;
+        hash = (hash ^ (0x80 | ((code >> 6) & 0x3f))) * FNV_PRIME;
+        hash = (hash ^ (0x80 | (code & 0x3f))) * FNV_PRIME;
+    }
+    return hash;
+}
+
+typedef UCDNNormalizer Normalizer;
+
+/* no codepoint below the limit fails the quick check or is a non-starter */
+static const uint32_t qc_limits[] = {0xc0, 0x300, 0xa0, 0xa0};
+
+/* the quick check values are ordered NFD, NFKD, NFC, NFKC */
+#define QC_FORM_SHIFT(form) ((((form) & 1) * 2 + ((form) >> 1)) * 2)
+
+/*
+ * Stream-Safe Text Format (UAX #15, section 13): no more than 30
+ * non-starters in a row, counted in NFKD. A combining grapheme joiner
+ * (a starter) is inserted to break up longer runs.
+ */
+#define STREAM_SAFE_MAX 30
+#define CGJ 0x34f
+
+/* Append the combining classes of the NFKD form of a codepoint. */
+static int nfkd_ccc(uint32_t code, uint8_t *ccc, int len)
+{
+    const DecompUnit *rec;
+    uint32_t a, b;
+    int i, rec_len;
+
+    if (hangul_pair_decompose(code, &a, &b)) {
+        len = nfkd_ccc(a, ccc, len);
+        return nfkd_ccc(b, ccc, len);
+    }
+
+    rec = get_decomp_record(code);
+    rec_len = rec[0] >> 8;
+    if (rec_len == 0) {
+        ccc[len] = (uint8_t)ucdn_get_combining_class(code);
+        return len + 1;
+    }
+
+    rec++;
+    for (i = 0; i < rec_len; i++)
+        len = nfkd_ccc(DECOMP_NEXT(rec), ccc, len);
+    return len;
+}
+
+/*
+ * Count the leading and trailing non-starters in the NFKD form of a
+ * codepoint, return the length of the NFKD form.
+ */
+static int stream_safe_counts(uint32_t code, int *lead, int *trail)
+{
+    uint8_t ccc[32];
+    int value, len;
+
+    /* without a decomposition, only the codepoint itself counts */
+    value = get_qc(code);
+    if (((value >> QC_FORM_SHIFT(UCDN_NORMALIZATION_NFKD)) & 3) == 0) {
+        *lead = *trail = (value >> 8) != 0;
+        return 1;
+    }
 
+    len = nfkd_ccc(code, ccc, 0);
+    *lead = *trail = 0;
+    while (*lead < len && ccc[*lead] != 0)
+        (*lead)++;
+    while (*trail < len && ccc[len - *trail - 1] != 0)
+        (*trail)++;
     return len;
 }
+
+/*
+ * Update the count of non-starters in a row for the next codepoint,
+ * whose NFKD form has len codepoints. Returns 1 if a CGJ has to be
+ * inserted before it.
+ */
+static int stream_safe_update(int *count, int len, int lead, int trail)
+{
+    int cgj = *count + lead > STREAM_SAFE_MAX;
+
+    if (cgj)
+        *count = 0;
+    *count = lead == len ? *count + len : trail;
+    return cgj;
+}
+
+static int stream_safe_step(int *count, uint32_t code)
+{
+    int len, lead, trail;
+
+    if (code < 0xa0) {
+        *count = 0;
+        return 0;
+    }
+    len = stream_safe_counts(code, &lead, &trail);
+    return stream_safe_update(count, len, lead, trail);
+}
+
+/*
+ * Set up a normalizer for the given form. Bit 0 of the form selects
+ * composition, bit 1 compatibility decomposition and bit 2 Stream-Safe
+ * Text Format.
+ */
+static int norm_init(Normalizer *n, int form, int encoding,
+                     void *dst, size_t dst_len)
+{
+    n->stream_safe = form & UCDN_NORMALIZATION_STREAM_SAFE;
+    form &= ~UCDN_NORMALIZATION_STREAM_SAFE;
+    if (form < UCDN_NORMALIZATION_NFD || form > UCDN_NORMALIZATION_NFKC)
+        return 0;
+
+    n->form = form;
+    n->compose = form & 1;
+    n->compat = form >> 1;
+    n->qc_shift = QC_FORM_SHIFT(form);
+    n->stream = 0;
+    n->error = 0;
+    n->overflow = 0;
+    n->nonstarters = 0;
+    n->len = 0;
+    n->encoding = encoding;
+    n->dst = dst;
+    n->dst_len = dst_len;
+    n->out = 0;
+    n->pos = 0;
+    n->starter_pos = 0;
+    n->pending_len = 0;
+    n->pending_pos = 0;
+    n->partial_len = 0;
+    return 1;
+}
+
+static size_t norm_units(const Normalizer *n, uint32_t code)
+{
+    if (n->encoding == ENCODING_UTF32)
+        return 1;
+    else if (n->encoding == ENCODING_UTF16)
+        return code < 0x10000 ? 1 : 2;
+    else
+        return code < 0x80 ? 1 : code < 0x800 ? 2 : code < 0x10000 ? 3 : 4;
+}
+
+/* Encode a codepoint into the output, return 0 if it does not fit. */
+static int norm_encode(Normalizer *n, uint32_t code)
+{
+    size_t len = norm_units(n, code), out = n->out;
+
+    if (out + len > n->dst_len)
+        return 0;
+
+    if (n->encoding == ENCODING_UTF32) {
+        ((uint32_t *)n->dst)[out] = code;
+    } else if (n->encoding == ENCODING_UTF16) {
+        uint16_t *dst = (uint16_t *)n->dst + out;
+
+        if (len == 1) {
+            dst[0] = (uint16_t)code;
+        } else {
+            dst[0] = (uint16_t)(0xd800 + ((code - 0x10000) >> 10));
+            dst[1] = (uint16_t)(0xdc00 + (code & 0x3ff));
+        }
+    } else if (n->encoding == ENCODING_HASH) {
+        *(uint32_t *)n->dst = hash_code(*(uint32_t *)n->dst, code);
+    } else {
+        uint8_t *dst = (uint8_t *)n->dst + out;
+
+        switch (len) {
+        case 1:
+            dst[0] = (uint8_t)code;
+            break;
+        case 2:
+            dst[0] = (uint8_t)(0xc0 | (code >> 6));
+            dst[1] = (uint8_t)(0x80 | (code & 0x3f));
+            break;
+        case 3:
+            dst[0] = (uint8_t)(0xe0 | (code >> 12));
+            dst[1] = (uint8_t)(0x80 | ((code >> 6) & 0x3f));
+            dst[2] = (uint8_t)(0x80 | (code & 0x3f));
+            break;
+        default:
+            dst[0] = (uint8_t)(0xf0 | (code >> 18));
+            dst[1] = (uint8_t)(0x80 | ((code >> 12) & 0x3f));
+            dst[2] = (uint8_t)(0x80 | ((code >> 6) & 0x3f));
+            dst[3] = (uint8_t)(0x80 | (code & 0x3f));
+        }
+    }
+    n->out = out + len;
+    return 1;
+}
+
+/*
+ * Write a codepoint to the output. If it does not fit, a streaming
+ * normalizer queues it until the next call, otherwise it is only
+ * counted, so that the required length can be reported.
+ */
+static void norm_emit(Normalizer *n, uint32_t code)
+{
+    if (n->pending_len == 0 && norm_encode(n, code))
+        return;
+
+    if (!n->stream)
+        n->out += norm_units(n, code);
+    else if (n->pending_len < UCDN_NORMALIZER_PENDING_MAX)
+        n->pending[n->pending_len++] = code;
+    else
+        n->error = 1;
+}
+
+/* Write queued output, return 0 if some of it is still left. */
+static int norm_drain(Normalizer *n)
+{
+    while (n->pending_pos < n->pending_len) {
+        if (!norm_encode(n, n->pending[n->pending_pos]))
+            return 0;
+        n->pending_pos++;
+    }
+    n->pending_len = n->pending_pos = 0;
+    return 1;
+}
+
+/*
+ * Put the non-starters of the segment into canonical order. Only the
+ * first codepoint of a segment can be a starter.
+ */
+static void norm_reorder(Normalizer *n)
+{
+    uint32_t run[UCDN_NORMALIZER_SEGMENT_MAX];
+    int start = n->len > 0 && n->ccc[0] == 0;
+    size_t len = (size_t)(n->len - start);
+
+    if (n->len - start < 2)
+        return;
+    if (len < REORDER_COUNTING_MIN) {
+        reorder_run(n->code + start, n->ccc + start, len, n->code + start);
+    } else {
+        memcpy(run, n->code + start, len * sizeof(uint32_t));
+        reorder_run(run, n->ccc + start, len, n->code + start);
+    }
+}
+
+/*
+ * Canonical composition of the segment. Only the first codepoint can be
+ * a starter, a non-starter is blocked from it if another uncomposed
+ * non-starter with the same or a higher combining class precedes it.
+ */
+static void norm_compose(Normalizer *n)
+{
+    int i, len = 1, last_ccc = 0;
+    uint32_t composed;
+
+    if (n->len < 2 || n->ccc[0] != 0)
+        return;
+
+    for (i = 1; i < n->len; i++) {
+        if (last_ccc < n->ccc[i] &&
+                ucdn_compose(&composed, n->code[0], n->code[i])) {
+            n->code[0] = composed;
+            continue;
+        }
+        last_ccc = n->ccc[i];
+        n->code[len] = n->code[i];
+        n->ccc[len] = n->ccc[i];
+        len++;
+    }
+    n->len = len;
+}
+
+static void norm_write(Normalizer *n)
+{
+    int i;
+
+    for (i = 0; i < n->len; i++)
+        norm_emit(n, n->code[i]);
+    n->len = 0;
+}
+
+/*
+ * Append a fully decomposed codepoint to the segment. If a run of
+ * non-starters does not fit, a streaming normalizer fails, otherwise
+ * the rest of the codepoint is dropped and the caller handles the run
+ * with norm_long_run().
+ */
+static void norm_push(Normalizer *n, uint32_t code, int ccc)
+{
+    if (ccc == 0) {
+        if (n->overflow)
+            return;
+        n->starter_pos = n->pos;
+    }
+
+    if (ccc == 0 && n->len > 0) {
+        norm_reorder(n);
+        if (n->compose) {
+            uint32_t composed;
+
+            norm_compose(n);
+            /* no codepoint below U+0300 composes with a preceding one */
+            if (n->len == 1 && n->ccc[0] == 0 && code >= 0x300 &&
+                    ucdn_compose(&composed, n->code[0], code)) {
+                n->code[0] = composed;
+                return;
+            }
+        }
+        norm_write(n);
+    }
+
+    if (n->len == UCDN_NORMALIZER_SEGMENT_MAX) {
+        if (n->stream)
+            n->error = 1;
+        else
+            n->overflow = 1;
+        return;
+    }
+    n->code[n->len] = code;
+    n->ccc[n->len] = (uint8_t)ccc;
+    n->len++;
+}
+
+/*
+ * Recursively decompose a codepoint into the segment. Canonical forms
+ * use the precomputed full decomposition, compatibility forms apply
+ * every mapping, whatever its type.
+ */
+static void norm_decompose(Normalizer *n, uint32_t code)
+{
+    const DecompUnit *rec;
+    uint32_t a, b, full[FULL_DECOMP_MAX];
+    int i, len;
+
+    /* canonical forms need a single lookup, no recursion */
+    if (!n->compat) {
+        len = ucdn_canonical_decompose_full(code, full);
+        if (len == 0) {
+            norm_push(n, code, ucdn_get_combining_class(code));
+            return;
+        }
+        for (i = 0; i < len; i++)
+            norm_push(n, full[i], ucdn_get_combining_class(full[i]));
+        return;
+    }
+
+    if (hangul_pair_decompose(code, &a, &b)) {
+        norm_decompose(n, a);
+        norm_decompose(n, b);
+        return;
+    }
+
+    rec = get_decomp_record(code);
+    len = rec[0] >> 8;
+    if (len == 0) {
+        norm_push(n, code, ucdn_get_combining_class(code));
+        return;
+    }
+
+    rec++;
+    for (i = 0; i < len; i++)
+        norm_decompose(n, DECOMP_NEXT(rec));
+}
+
+static void norm_add(Normalizer *n, uint32_t code)
+{
+    if (n->stream_safe && stream_safe_step(&n->nonstarters, code))
+        norm_push(n, CGJ, 0);
+
+    /*
+     * Nothing below U+00A0 decomposes or is a non-starter, and nothing
+     * below U+00C0 has a canonical decomposition.
+     */
+    if (code < 0xa0 || (code < 0xc0 && !n->compat))
+        norm_push(n, code, 0);
+    else
+        norm_decompose(n, code);
+}
+
+/* Write out the segment, the text that follows cannot change it. */
+static void norm_flush(Normalizer *n)
+{
+    norm_reorder(n);
+    if (n->compose)
+        norm_compose(n);
+    norm_write(n);
+}
+
+static size_t norm_finish(Normalizer *n)
+{
+    norm_flush(n);
+    return n->error ? UCDN_NORMALIZE_ERROR : n->out;
+}
+
+static uint32_t read_utf16(const uint16_t *src, size_t len, size_t *pos)
+{
+    uint32_t code = src[(*pos)++];
+
+    if (code >= 0xd800 && code < 0xe000) {
+        if (code < 0xdc00 && *pos < len &&
+                src[*pos] >= 0xdc00 && src[*pos] < 0xe000)
+            return 0x10000 + ((code - 0xd800) << 10) +
+                (src[(*pos)++] - 0xdc00);
+        return 0xfffd;
+    }
+    return code;
+}
+
+/*
+ * Decode a codepoint from UTF-8. Ill-formed sequences are replaced with
+ * U+FFFD, one for each maximal subpart as recommended by the Unicode
+ * standard.
+ */
+static uint32_t read_utf8(const uint8_t *src, size_t len, size_t *pos)
+{
+    size_t i = *pos;
+    uint32_t code = src[i++];
+    int n;
+    uint8_t lo = 0x80, hi = 0xbf;
+
+    if (code < 0x80) {
+        *pos = i;
+        return code;
+    } else if (code >= 0xc2 && code <= 0xdf) {
+        n = 1;
+        code &= 0x1f;
+    } else if (code >= 0xe0 && code <= 0xef) {
+        n = 2;
+        if (code == 0xe0)
+            lo = 0xa0;
+        else if (code == 0xed)
+            hi = 0x9f;
+        code &= 0x0f;
+    } else if (code >= 0xf0 && code <= 0xf4) {
+        n = 3;
+        if (code == 0xf0)
+            lo = 0x90;
+        else if (code == 0xf4)
+            hi = 0x8f;
+        code &= 0x07;
+    } else {
+        *pos = i;
+        return 0xfffd;
+    }
+
+    for (; n > 0; n--) {
+        if (i >= len || src[i] < lo || src[i] > hi) {
+            *pos = i;
+            return 0xfffd;
+        }
+        code = (code << 6) | (src[i++] & 0x3f);
+        lo = 0x80;
+        hi = 0xbf;
+    }
+
+    *pos = i;
+    return code;
+}
+
+static uint32_t read_code(int encoding, const void *src, size_t len,
+                          size_t *pos)
+{
+    if (encoding == ENCODING_UTF32)
+        return ((const uint32_t *)src)[(*pos)++];
+    else if (encoding == ENCODING_UTF16)
+        return read_utf16((const uint16_t *)src, len, pos);
+    else
+        return read_utf8((const uint8_t *)src, len, pos);
+}
+
+/*
+ * Normalization quick check. A codepoint with the quick check value yes
+ * and combining class 0 is a boundary: normalizing the text after it
+ * does not change the text before it.
+ */
+typedef struct {
+    int shift;
+    int last_ccc;
+    size_t boundary;
+    uint32_t limit;
+    int stream_safe;
+    int nonstarters;
+} QuickCheck;
+
+/*
+ * For Stream-Safe Text Format, the scan also counts non-starters,
+ * starting from the count before the text.
+ */
+static int qc_init(QuickCheck *qc, int form, int nonstarters)
+{
+    qc->stream_safe = form & UCDN_NORMALIZATION_STREAM_SAFE;
+    form &= ~UCDN_NORMALIZATION_STREAM_SAFE;
+    if (form < UCDN_NORMALIZATION_NFD || form > UCDN_NORMALIZATION_NFKC)
+        return 0;
+
+    qc->shift = QC_FORM_SHIFT(form);
+    qc->last_ccc = 0;
+    qc->boundary = 0;
+    /* compatibility characters below U+00C0 can add non-starters */
+    qc->limit = qc->stream_safe ? 0xa0 : qc_limits[form];
+    qc->nonstarters = nonstarters;
+    return 1;
+}
+
+/*
+ * Check the codepoint at pos, return 0 if the quick check fails or a CGJ
+ * would have to be inserted. For Stream-Safe Text Format, a starter is
+ * only a boundary if its NFKD form starts with a starter, so that the
+ * count of non-starters before it does not matter.
+ */
+static int qc_step(QuickCheck *qc, uint32_t code, size_t pos)
+{
+    int value = get_qc(code), ccc = value >> 8, len, lead = 0, trail;
+
+    if ((ccc != 0 && qc->last_ccc > ccc) || ((value >> qc->shift) & 3))
+        return 0;
+    if (qc->stream_safe && code >= 0xa0) {
+        len = stream_safe_counts(code, &lead, &trail);
+        if (stream_safe_update(&qc->nonstarters, len, lead, trail))
+            return 0;
+    } else {
+        qc->nonstarters = 0;
+    }
+    if (ccc == 0 && lead == 0)
+        qc->boundary = pos;
+    qc->last_ccc = ccc;
+    return 1;
+}
+
+/*
+ * Skip a block of 8 code units below limit, which are all boundaries,
+ * without any table lookups, and continue the scan loop. The test has
+ * no branches, so that it can be vectorized.
+ */
+#define QC_SKIP_BLOCK(qc, src, len, i, limit) \
+    if ((i) + 8 <= (len)) { \
+        int above_ = 0, j_; \
+        for (j_ = 0; j_ < 8; j_++) \
+            above_ |= (src)[(i) + j_] >= (limit); \
+        if (!above_) { \
+            (i) += 8; \
+            (qc).boundary = (i) - 1; \
+            (qc).last_ccc = 0; \
+            (qc).nonstarters = 0; \
+            continue; \
+        } \
+    }
+
+int ucdn_get_quick_check(uint32_t code, int form)
+{
+    QuickCheck qc;
+
+    if ((form & UCDN_NORMALIZATION_STREAM_SAFE) || !qc_init(&qc, form, 0))
+        return -1;
+    return (get_qc(code) >> qc.shift) & 3;
+}
+
+/*
+ * Scan for the normalized prefix. In the middle of a stream (at_end 0),
+ * the text that follows may still change the last segment, so the scan
+ * always ends at the last boundary. For Stream-Safe Text Format, the
+ * count of non-starters before the text is passed in.
+ */
+static size_t qc_prefix(int form, const uint32_t *src, size_t len,
+                        int at_end, int nonstarters)
+{
+    QuickCheck qc;
+    size_t i = 0;
+
+    if (!qc_init(&qc, form, nonstarters))
+        return 0;
+
+    while (i < len) {
+        if (src[i] < qc.limit)
+            QC_SKIP_BLOCK(qc, src, len, i, qc.limit);
+        if (!qc_step(&qc, src[i], i))
+            return qc.boundary;
+        i++;
+    }
+    return at_end ? len : qc.boundary;
+}
+
+static size_t qc_prefix_utf16(int form, const uint16_t *src, size_t len,
+                              int at_end, int nonstarters)
+{
+    QuickCheck qc;
+    size_t i = 0, start;
+    uint32_t code;
+
+    if (!qc_init(&qc, form, nonstarters))
+        return 0;
+
+    while (i < len) {
+        if (src[i] < qc.limit)
+            QC_SKIP_BLOCK(qc, src, len, i, qc.limit);
+        start = i;
+        code = read_utf16(src, len, &i);
+        /* unpaired surrogates are replaced when normalizing */
+        if ((code == 0xfffd && src[start] != 0xfffd) ||
+                !qc_step(&qc, code, start))
+            return qc.boundary;
+    }
+    return at_end ? len : qc.boundary;
+}
+
+static size_t qc_prefix_utf8(int form, const uint8_t *src, size_t len,
+                             int at_end, int nonstarters)
+{
+    QuickCheck qc;
+    size_t i = 0, start;
+    uint32_t code;
+
+    if (!qc_init(&qc, form, nonstarters))
+        return 0;
+
+    while (i < len) {
+        if (src[i] < 0x80)
+            QC_SKIP_BLOCK(qc, src, len, i, 0x80);
+        start = i;
+        code = read_utf8(src, len, &i);
+        /* ill-formed sequences are replaced when normalizing */
+        if ((code == 0xfffd && (i - start != 3 || src[start] != 0xef)) ||
+                !qc_step(&qc, code, start))
+            return qc.boundary;
+    }
+    return at_end ? len : qc.boundary;
+}
+
+size_t ucdn_normalized_prefix(int form, const uint32_t *src, size_t len)
+{
+    return qc_prefix(form, src, len, 1, 0);
+}
+
+size_t ucdn_normalized_prefix_utf16(int form, const uint16_t *src,
+                                    size_t len)
+{
+    return qc_prefix_utf16(form, src, len, 1, 0);
+}
+
+size_t ucdn_normalized_prefix_utf8(int form, const uint8_t *src, size_t len)
+{
+    return qc_prefix_utf8(form, src, len, 1, 0);
+}
+
+static size_t norm_unit_size(const Normalizer *n)
+{
+    if (n->encoding == ENCODING_UTF32)
+        return sizeof(uint32_t);
+    else if (n->encoding == ENCODING_UTF16)
+        return sizeof(uint16_t);
+    else
+        return 1;
+}
+
+/*
+ * Copy normalized input to the output as is, unless it does not fit.
+ * The copy ends before a boundary, where the count of non-starters
+ * starts over. Returns the number of code units consumed.
+ */
+static size_t norm_copy(Normalizer *n, const void *src, size_t len)
+{
+    size_t size = norm_unit_size(n);
+
+    if (len == 0 || len > n->dst_len - n->out)
+        return 0;
+
+    memcpy((char *)n->dst + n->out * size, src, len * size);
+    n->out += len;
+    n->nonstarters = 0;
+    return len;
+}
+
+/*
+ * Runs of non-starters longer than the segment
+ *
+ * The whole input of a one-shot normalization is at hand, so such a run
+ * is not buffered, but decomposed from the input again for every
+ * combining class in it: first to compose the starter with the run, then
+ * to write out the codepoints of each class in turn. The run starts after
+ * the last starter pushed into the segment, which norm_push() notes the
+ * input position of.
+ */
+
+/* longest decomposition of a single input codepoint */
+#define EXPAND_MAX (NFKC_CF_MAX * FULL_DECOMP_MAX)
+
+typedef struct {
+    Normalizer *n;
+    int encoding;
+    int fold;
+    const void *src;
+    size_t len;
+    size_t pos;
+    int skip;
+    size_t end;
+    int end_skip;
+} LongRun;
+
+/*
+ * Fully decompose an input codepoint, after NFKC_Casefold if fold is set,
+ * return the number of codepoints written to out.
+ */
+static int norm_expand(const Normalizer *n, int fold, uint32_t code,
+                       uint32_t *out)
+{
+    Normalizer t;
+    uint32_t mapped[NFKC_CF_MAX];
+    int i, len = 1;
+
+    norm_init(&t, n->form & ~1, ENCODING_UTF32, out, EXPAND_MAX);
+    if (fold)
+        len = ucdn_nfkc_casefold(code, mapped);
+    else
+        mapped[0] = code;
+    for (i = 0; i < len; i++)
+        norm_add(&t, mapped[i]);
+    norm_flush(&t);
+    return (int)t.out;
+}
+
+/*
+ * Go through the codepoints of combining class ccc in the run. If
+ * starter is set, compose them with it until one does not compose and
+ * count those that did, otherwise write them out except for the first
+ * count ones. Returns the lowest combining class in the run above ccc,
+ * or 256 if there is none. The run starts skip codepoints into the
+ * decomposition at r->pos and ends before the next starter, which is
+ * where r->end and r->end_skip are set once ccc is 0.
+ */
+static int long_run_pass(LongRun *r, int ccc, uint32_t *starter, int *count)
+{
+    uint32_t code[EXPAND_MAX], composed;
+    size_t pos = r->pos, start;
+    int i, len, c, next = 256, skip = r->skip, blocked = 0, written = 0;
+
+    while (pos < r->len) {
+        start = pos;
+        len = norm_expand(r->n, r->fold,
+                          read_code(r->encoding, r->src, r->len, &pos), code);
+        for (i = skip; i < len; i++) {
+            c = ucdn_get_combining_class(code[i]);
+            if (c == 0) {
+                if (ccc == 0) {
+                    r->end = start;
+                    r->end_skip = i;
+                }
+                return next;
+            }
+            if (c > ccc && c < next)
+                next = c;
+            if (c != ccc)
+                continue;
+
+            if (starter) {
+                if (!blocked && ucdn_compose(&composed, *starter, code[i])) {
+                    *starter = composed;
+                    (*count)++;
+                } else {
+                    blocked = 1;
+                }
+            } else if (written++ >= *count) {
+                norm_emit(r->n, code[i]);
+            }
+        }
+        skip = 0;
+    }
+
+    if (ccc == 0) {
+        r->end = pos;
+        r->end_skip = 0;
+    }
+    return next;
+}
+
+/*
+ * Normalize the run of non-starters that overflowed the segment and the
+ * rest of the input codepoint that ends it. The input encoding is given
+ * separately, as the output may be hashed. Returns the input position to
+ * continue at.
+ */
+static size_t norm_long_run(Normalizer *n, int encoding, int fold,
+                            const void *src, size_t len)
+{
+    LongRun r;
+    uint32_t code[EXPAND_MAX], starter = n->code[0];
+    int composed[256], i, first, ccc, count;
+
+    /* the run starts after the last starter of the noted codepoint */
+    r.n = n;
+    r.encoding = encoding;
+    r.fold = fold;
+    r.src = src;
+    r.len = len;
+    r.pos = n->starter_pos;
+    count = norm_expand(n, fold, read_code(encoding, src, len, &r.pos), code);
+    r.skip = count;
+    while (r.skip > 0 && ucdn_get_combining_class(code[r.skip - 1]) != 0)
+        r.skip--;
+    if (r.skip < count)
+        r.pos = n->starter_pos;
+    else
+        r.skip = 0;
+
+    memset(composed, 0, sizeof(composed));
+    first = long_run_pass(&r, 0, NULL, &count);
+    if (n->ccc[0] == 0) {
+        if (n->compose)
+            for (ccc = first; ccc < 256;)
+                ccc = long_run_pass(&r, ccc, &starter, &composed[ccc]);
+        norm_emit(n, starter);
+    }
+    for (ccc = first; ccc < 256;)
+        ccc = long_run_pass(&r, ccc, NULL, &composed[ccc]);
+
+    n->len = 0;
+    n->overflow = 0;
+    if (r.end == len)
+        return len;
+
+    /* the codepoint with the starter that ends the run */
+    n->pos = r.end;
+    count = norm_expand(n, fold, read_code(encoding, src, len, &r.end), code);
+    for (i = r.end_skip; i < count; i++)
+        norm_push(n, code[i], ucdn_get_combining_class(code[i]));
+    return r.end;
+}
+
+size_t ucdn_normalize(int form, const uint32_t *src, size_t len,
+                      uint32_t *dst, size_t dst_len)
+{
+    Normalizer n;
+    size_t i;
+
+    if (!norm_init(&n, form, ENCODING_UTF32, dst, dst_len))
+        return UCDN_NORMALIZE_ERROR;
+    i = norm_copy(&n, src, qc_prefix(form, src, len, 1, 0));
+    while (i < len) {
+        n.pos = i;
+        norm_add(&n, src[i++]);
+        if (n.overflow)
+            i = norm_long_run(&n, ENCODING_UTF32, 0, src, len);
+    }
+    return norm_finish(&n);
+}
+
+size_t ucdn_normalize_utf16(int form, const uint16_t *src, size_t len,
+                            uint16_t *dst, size_t dst_len)
+{
+    Normalizer n;
+    size_t i;
+
+    if (!norm_init(&n, form, ENCODING_UTF16, dst, dst_len))
+        return UCDN_NORMALIZE_ERROR;
+    i = norm_copy(&n, src, qc_prefix_utf16(form, src, len, 1, 0));
+    while (i < len) {
+        n.pos = i;
+        norm_add(&n, read_utf16(src, len, &i));
+        if (n.overflow)
+            i = norm_long_run(&n, ENCODING_UTF16, 0, src, len);
+    }
+    return norm_finish(&n);
+}
+
+size_t ucdn_normalize_utf8(int form, const uint8_t *src, size_t len,
+                           uint8_t *dst, size_t dst_len)
+{
+    Normalizer n;
+    size_t i;
+
+    if (!norm_init(&n, form, ENCODING_UTF8, dst, dst_len))
+        return UCDN_NORMALIZE_ERROR;
+    i = norm_copy(&n, src, qc_prefix_utf8(form, src, len, 1, 0));
+    while (i < len) {
+        n.pos = i;
+        norm_add(&n, read_utf8(src, len, &i));
+        if (n.overflow)
+            i = norm_long_run(&n, ENCODING_UTF8, 0, src, len);
+    }
+    return norm_finish(&n);
+}
+
+/*
+ * Streaming normalization
+ *
+ * The normalizer keeps the segment of the last starter between calls,
+ * as the input that follows may still reorder or compose it. Whenever a
+ * boundary is reached, the segment is written out and the normalized
+ * input following it, as found by the quick check, is copied as is.
+ * Output that does not fit is queued, and input is only consumed while
+ * the queue is empty, so the state stays bounded. Sequences cut off at
+ * the end of a chunk are kept until the next one.
+ */
+
+static int norm_is_boundary(const Normalizer *n, uint32_t code)
+{
+    int value;
+
+    if (code < qc_limits[n->form])
+        return 1;
+    value = get_qc(code);
+    return (value >> 8) == 0 && ((value >> n->qc_shift) & 3) == 0;
+}
+
+static uint32_t norm_read(const Normalizer *n, const void *src, size_t len,
+                          size_t *pos)
+{
+    return read_code(n->encoding, src, len, pos);
+}
+
+static size_t norm_scan(const Normalizer *n, const void *src, size_t len)
+{
+    int form = n->form | n->stream_safe;
+
+    if (n->encoding == ENCODING_UTF32)
+        return qc_prefix(form, (const uint32_t *)src, len, 0,
+                         n->nonstarters);
+    else if (n->encoding == ENCODING_UTF16)
+        return qc_prefix_utf16(form, (const uint16_t *)src, len, 0,
+                               n->nonstarters);
+    else
+        return qc_prefix_utf8(form, (const uint8_t *)src, len, 0,
+                              n->nonstarters);
+}
+
+/*
+ * Length of a UTF-8 sequence at the end of src that is well-formed so
+ * far but incomplete, 0 if there is none.
+ */
+static size_t utf8_tail(const uint8_t *src, size_t len)
+{
+    size_t i, pos, need;
+
+    for (i = len; i > 0 && len - i < 3; i--) {
+        uint8_t c = src[i - 1];
+
+        if (c < 0x80 || (c >= 0xc0 && c < 0xc2) || c > 0xf4)
+            return 0;
+        if (c >= 0xc0) {
+            need = c < 0xe0 ? 2 : c < 0xf0 ? 3 : 4;
+            pos = i - 1;
+            if (len - pos >= need)
+                return 0;
+            read_utf8(src, len, &pos);
+            return pos == len ? len - (i - 1) : 0;
+        }
+    }
+    return 0;
+}
+
+/* Length of an incomplete sequence at the end of src. */
+static size_t stream_tail(int encoding, const void *src, size_t len)
+{
+    const uint16_t *src16 = (const uint16_t *)src;
+
+    if (encoding == ENCODING_UTF16)
+        return len > 0 && src16[len - 1] >= 0xd800 &&
+            src16[len - 1] < 0xdc00;
+    else if (encoding == ENCODING_UTF8)
+        return utf8_tail((const uint8_t *)src, len);
+    return 0;
+}
+
+/*
+ * Complete the sequence kept from the previous chunk in partial. Returns
+ * 0 if it is still incomplete, otherwise the codepoint is stored in code
+ * and pos is set past the code units taken from src.
+ */
+static int stream_resume(int encoding, uint32_t *partial, int *partial_len,
+                         const void *src, size_t len, size_t *pos,
+                         uint32_t *code)
+{
+    if (encoding == ENCODING_UTF16) {
+        const uint16_t *src16 = (const uint16_t *)src;
+
+        if (len == 0)
+            return 0;
+        if (src16[0] >= 0xdc00 && src16[0] < 0xe000) {
+            *code = 0x10000 + ((partial[0] - 0xd800) << 10) +
+                (src16[0] - 0xdc00);
+            *pos = 1;
+        } else {
+            *code = 0xfffd;
+            *pos = 0;
+        }
+    } else {
+        uint8_t buf[4];
+        size_t i, buf_len = *partial_len, used = 0;
+
+        for (i = 0; i < buf_len; i++)
+            buf[i] = (uint8_t)partial[i];
+        for (i = 0; i < len && buf_len < 4; i++)
+            buf[buf_len++] = ((const uint8_t *)src)[i];
+
+        if (utf8_tail(buf, buf_len) == buf_len) {
+            for (i = 0; i < buf_len; i++)
+                partial[i] = buf[i];
+            *partial_len = (int)buf_len;
+            *pos = len;
+            return 0;
+        }
+        *code = read_utf8(buf, buf_len, &used);
+        *pos = used - *partial_len;
+    }
+    *partial_len = 0;
+    return 1;
+}
+
+static size_t norm_put(Normalizer *n, const void *src, size_t len,
+                       size_t *consumed)
+{
+    const char *bytes = (const char *)src;
+    size_t i = 0, end, start, room, copied, size = norm_unit_size(n);
+    uint32_t code;
+
+    *consumed = 0;
+    n->out = 0;
+    if (n->error)
+        return UCDN_NORMALIZE_ERROR;
+    if (!norm_drain(n))
+        return n->out;
+
+    if (n->partial_len > 0) {
+        if (!stream_resume(n->encoding, n->partial, &n->partial_len, src,
+                           len, &i, &code)) {
+            *consumed = len;
+            return n->out;
+        }
+        norm_add(n, code);
+    }
+
+    end = len - stream_tail(n->encoding, src, len);
+    while (i < end && n->pending_len == 0) {
+        start = i;
+        code = norm_read(n, src, end, &i);
+        if (norm_is_boundary(n, code)) {
+            norm_flush(n);
+            if (n->pending_len > 0) {
+                i = start;
+                break;
+            }
+            room = n->dst_len - n->out;
+            copied = norm_copy(n, bytes + start * size,
+                norm_scan(n, bytes + start * size,
+                          end - start < room ? end - start : room));
+            if (copied > 0) {
+                i = start + copied;
+                continue;
+            }
+        }
+        norm_add(n, code);
+    }
+
+    /* keep an incomplete sequence at the end for the next chunk */
+    if (i == end) {
+        for (; i < len; i++)
+            n->partial[n->partial_len++] = n->encoding == ENCODING_UTF16 ?
+                ((const uint16_t *)src)[i] : ((const uint8_t *)src)[i];
+    }
+
+    *consumed = i;
+    return n->error ? UCDN_NORMALIZE_ERROR : n->out;
+}
+
+static size_t norm_put_finish(Normalizer *n)
+{
+    n->out = 0;
+    if (n->error)
+        return UCDN_NORMALIZE_ERROR;
+    if (!norm_drain(n))
+        return n->out;
+
+    /* an incomplete sequence at the end of the stream is ill-formed */
+    if (n->partial_len > 0) {
+        n->partial_len = 0;
+        norm_add(n, 0xfffd);
+    }
+    return norm_finish(n);
+}
+
+int ucdn_normalizer_init(UCDNNormalizer *n, int form)
+{
+    if (!norm_init(n, form, ENCODING_UTF32, NULL, 0))
+        return 0;
+    n->stream = 1;
+    return 1;
+}
+
+size_t ucdn_normalizer_put(UCDNNormalizer *n, const uint32_t *src,
+                           size_t len, size_t *consumed,
+                           uint32_t *dst, size_t dst_len)
+{
+    n->encoding = ENCODING_UTF32;
+    n->dst = dst;
+    n->dst_len = dst_len;
+    return norm_put(n, src, len, consumed);
+}
+
+size_t ucdn_normalizer_put_utf16(UCDNNormalizer *n, const uint16_t *src,
+                                 size_t len, size_t *consumed,
+                                 uint16_t *dst, size_t dst_len)
+{
+    n->encoding = ENCODING_UTF16;
+    n->dst = dst;
+    n->dst_len = dst_len;
+    return norm_put(n, src, len, consumed);
+}
+
+size_t ucdn_normalizer_put_utf8(UCDNNormalizer *n, const uint8_t *src,
+                                size_t len, size_t *consumed,
+                                uint8_t *dst, size_t dst_len)
+{
+    n->encoding = ENCODING_UTF8;
+    n->dst = dst;
+    n->dst_len = dst_len;
+    return norm_put(n, src, len, consumed);
+}
+
+size_t ucdn_normalizer_finish(UCDNNormalizer *n, uint32_t *dst,
+                              size_t dst_len)
+{
+    n->encoding = ENCODING_UTF32;
+    n->dst = dst;
+    n->dst_len = dst_len;
+    return norm_put_finish(n);
+}
+
+size_t ucdn_normalizer_finish_utf16(UCDNNormalizer *n, uint16_t *dst,
+                                    size_t dst_len)
+{
+    n->encoding = ENCODING_UTF16;
+    n->dst = dst;
+    n->dst_len = dst_len;
+    return norm_put_finish(n);
+}
+
+size_t ucdn_normalizer_finish_utf8(UCDNNormalizer *n, uint8_t *dst,
+                                   size_t dst_len)
+{
+    n->encoding = ENCODING_UTF8;
+    n->dst = dst;
+    n->dst_len = dst_len;
+    return norm_put_finish(n);
+}
+
+static size_t stream_safe_pass(int encoding, const void *src, size_t len,
+                               void *dst, size_t dst_len)
+{
+    Normalizer n;
+    size_t i = 0;
+    int nonstarters = 0;
+    uint32_t code;
+
+    norm_init(&n, UCDN_NORMALIZATION_NFD, encoding, dst, dst_len);
+    while (i < len) {
+        code = norm_read(&n, src, len, &i);
+        if (stream_safe_step(&nonstarters, code))
+            norm_emit(&n, CGJ);
+        norm_emit(&n, code);
+    }
+    return n.out;
+}
+
+size_t ucdn_stream_safe(const uint32_t *src, size_t len,
+                        uint32_t *dst, size_t dst_len)
+{
+    return stream_safe_pass(ENCODING_UTF32, src, len, dst, dst_len);
+}
+
+size_t ucdn_stream_safe_utf16(const uint16_t *src, size_t len,
+                              uint16_t *dst, size_t dst_len)
+{
+    return stream_safe_pass(ENCODING_UTF16, src, len, dst, dst_len);
+}
+
+size_t ucdn_stream_safe_utf8(const uint8_t *src, size_t len,
+                             uint8_t *dst, size_t dst_len)
+{
+    return stream_safe_pass(ENCODING_UTF8, src, len, dst, dst_len);
+}
+
+/*
+ * Case mapping
+ *
+ * The simple mappings and the simple case folding are stored as deltas,
+ * shared by many codepoints. Codepoints listed in SpecialCasing.txt or
+ * with a full case folding that differs from the simple one have their
+ * full mappings in case_special. The conditional mappings there are
+ * language-specific, except for the final form of capital sigma, which
+ * is handled when lowercasing strings.
+ */
+
+/* the order of the full mappings in case_special */
+#define CASE_LOWER 0
+#define CASE_TITLE 1
+#define CASE_UPPER 2
+#define CASE_FOLD 3
+#define CASE_FOLD_SIMPLE 4
+
+#define CASE_CASED 1
+#define CASE_IGNORABLE 2
+
+uint32_t ucdn_to_lower(uint32_t code)
+{
+    return code + get_case_record(code)->lower;
+}
+
+uint32_t ucdn_to_upper(uint32_t code)
+{
+    return code + get_case_record(code)->upper;
+}
+
+uint32_t ucdn_to_title(uint32_t code)
+{
+    return code + get_case_record(code)->title;
+}
+
+uint32_t ucdn_fold_case(uint32_t code)
+{
+    return code + get_case_record(code)->fold;
+}
+
+static int case_full(uint32_t code, int mapping, uint32_t *mapped)
+{
+    const CaseRecord *rec = get_case_record(code);
+    int i, header, start, len;
+
+    if (rec->special == 0 || mapping == CASE_FOLD_SIMPLE) {
+        if (mapping == CASE_LOWER)
+            mapped[0] = code + rec->lower;
+        else if (mapping == CASE_TITLE)
+            mapped[0] = code + rec->title;
+        else if (mapping == CASE_UPPER)
+            mapped[0] = code + rec->upper;
+        else
+            mapped[0] = code + rec->fold;
+        return 1;
+    }
+
+    header = case_special[rec->special];
+    start = rec->special + 1;
+    for (i = 0; i < mapping; i++)
+        start += (header >> (4 * i)) & 0xf;
+    len = (header >> (4 * mapping)) & 0xf;
+    for (i = 0; i < len; i++)
+        mapped[i] = case_special[start + i];
+    return len;
+}
+
+int ucdn_to_lower_full(uint32_t code, uint32_t *mapped)
+{
+    return case_full(code, CASE_LOWER, mapped);
+}
+
+int ucdn_to_upper_full(uint32_t code, uint32_t *mapped)
+{
+    return case_full(code, CASE_UPPER, mapped);
+}
+
+int ucdn_to_title_full(uint32_t code, uint32_t *mapped)
+{
+    return case_full(code, CASE_TITLE, mapped);
+}
+
+int ucdn_fold_case_full(uint32_t code, uint32_t *mapped)
+{
+    return case_full(code, CASE_FOLD, mapped);
+}
+
+int ucdn_nfkc_casefold(uint32_t code, uint32_t *mapped)
+{
+    const unsigned int *rec;
+    int i, len, index = get_nfkc_cf_index(code);
+
+    if (index == 0) {
+        mapped[0] = code;
+        return 1;
+    }
+
+    rec = &nfkc_cf_data[index];
+    len = rec[0] >> 24;
+    if (len == 0)
+        return 0;
+    mapped[0] = rec[0] & 0xffffff;
+    for (i = 1; i < len; i++)
+        mapped[i] = rec[i];
+    return len;
+}
+
+/*
+ * Decode the codepoint before pos and move pos to its start. Ill-formed
+ * sequences decode to U+FFFD, but not necessarily with the same
+ * boundaries as when reading forward.
+ */
+static uint32_t norm_read_back(const Normalizer *n, const void *src,
+                               size_t *pos)
+{
+    size_t i = *pos - 1, start;
+    uint32_t code;
+
+    if (n->encoding == ENCODING_UTF32) {
+        *pos = i;
+        return ((const uint32_t *)src)[i];
+    } else if (n->encoding == ENCODING_UTF16) {
+        const uint16_t *src16 = (const uint16_t *)src;
+
+        code = src16[i];
+        if (code >= 0xdc00 && code < 0xe000 && i > 0 &&
+                src16[i - 1] >= 0xd800 && src16[i - 1] < 0xdc00) {
+            *pos = i - 1;
+            return 0x10000 + ((src16[i - 1] - 0xd800) << 10) +
+                (code - 0xdc00);
+        }
+        *pos = i;
+        return code >= 0xd800 && code < 0xe000 ? 0xfffd : code;
+    } else {
+        const uint8_t *src8 = (const uint8_t *)src;
+        size_t end;
+
+        start = i;
+        while (start > 0 && i - start < 3 && (src8[start] & 0xc0) == 0x80)
+            start--;
+        end = start;
+        code = read_utf8(src8, *pos, &end);
+        if (end == *pos) {
+            *pos = start;
+            return code;
+        }
+        *pos = i;
+        return 0xfffd;
+    }
+}
+
+/*
+ * Capital sigma is lowercased to final sigma if it follows a cased
+ * letter and no cased letter follows it, skipping case-ignorable
+ * characters in both directions (Final_Sigma in chapter 3.13 of the
+ * Unicode core specification).
+ */
+static int case_final_sigma(const Normalizer *n, const void *src,
+                            size_t len, size_t start, size_t end)
+{
+    int flags = 0;
+
+    while (start > 0) {
+        flags = get_case_record(norm_read_back(n, src, &start))->flags;
+        if (!(flags & CASE_IGNORABLE))
+            break;
+    }
+    if (!(flags & CASE_CASED) || (flags & CASE_IGNORABLE))
+        return 0;
+
+    while (end < len) {
+        flags = get_case_record(norm_read(n, src, len, &end))->flags;
+        if (!(flags & CASE_IGNORABLE))
+            return !(flags & CASE_CASED);
+    }
+    return 1;
+}
+
+/*
+ * Convert a block of 8 ASCII code units at once, return 0 if the block
+ * has other characters. As with QC_SKIP_BLOCK, the loops have no
+ * branches, so that they can be vectorized.
+ */
+#define CASE_ASCII_BLOCK(type, src, i, dst, out, first) do { \
+    const type *s_ = (const type *)(src) + (i); \
+    type *d_ = (type *)(dst) + (out); \
+    int above_ = 0, j_; \
+    for (j_ = 0; j_ < 8; j_++) \
+        above_ |= s_[j_] >= 0x80; \
+    if (above_) \
+        return 0; \
+    for (j_ = 0; j_ < 8; j_++) \
+        d_[j_] = (type)(s_[j_] ^ \
+            ((uint32_t)(s_[j_] - (first)) < 26) << 5); \
+} while (0)
+
+static int case_ascii_block(Normalizer *n, const void *src, size_t len,
+                            size_t *pos, int mapping)
+{
+    uint32_t first = mapping == CASE_UPPER ? 'a' : 'A';
+
+    if (*pos + 8 > len || n->out + 8 > n->dst_len)
+        return 0;
+
+    if (n->encoding == ENCODING_UTF32)
+        CASE_ASCII_BLOCK(uint32_t, src, *pos, n->dst, n->out, first);
+    else if (n->encoding == ENCODING_UTF16)
+        CASE_ASCII_BLOCK(uint16_t, src, *pos, n->dst, n->out, first);
+    else
+        CASE_ASCII_BLOCK(uint8_t, src, *pos, n->dst, n->out, first);
+    *pos += 8;
+    n->out += 8;
+    return 1;
+}
+
+static size_t case_convert(int mapping, int encoding, const void *src,
+                           size_t len, void *dst, size_t dst_len)
+{
+    Normalizer n;
+    size_t i = 0, start;
+    uint32_t code, mapped[3];
+    int j, mapped_len;
+
+    norm_init(&n, UCDN_NORMALIZATION_NFD, encoding, dst, dst_len);
+    while (i < len) {
+        if (case_ascii_block(&n, src, len, &i, mapping))
+            continue;
+
+        start = i;
+        code = norm_read(&n, src, len, &i);
+        if (code == 0x3a3 && mapping == CASE_LOWER &&
+                case_final_sigma(&n, src, len, start, i)) {
+            norm_emit(&n, 0x3c2);
+            continue;
+        }
+        mapped_len = case_full(code, mapping, mapped);
+        for (j = 0; j < mapped_len; j++)
+            norm_emit(&n, mapped[j]);
+    }
+    return n.out;
+}
+
+size_t ucdn_lowercase(const uint32_t *src, size_t len,
+                      uint32_t *dst, size_t dst_len)
+{
+    return case_convert(CASE_LOWER, ENCODING_UTF32, src, len, dst, dst_len);
+}
+
+size_t ucdn_lowercase_utf16(const uint16_t *src, size_t len,
+                            uint16_t *dst, size_t dst_len)
+{
+    return case_convert(CASE_LOWER, ENCODING_UTF16, src, len, dst, dst_len);
+}
+
+size_t ucdn_lowercase_utf8(const uint8_t *src, size_t len,
+                           uint8_t *dst, size_t dst_len)
+{
+    return case_convert(CASE_LOWER, ENCODING_UTF8, src, len, dst, dst_len);
+}
+
+size_t ucdn_uppercase(const uint32_t *src, size_t len,
+                      uint32_t *dst, size_t dst_len)
+{
+    return case_convert(CASE_UPPER, ENCODING_UTF32, src, len, dst, dst_len);
+}
+
+size_t ucdn_uppercase_utf16(const uint16_t *src, size_t len,
+                            uint16_t *dst, size_t dst_len)
+{
+    return case_convert(CASE_UPPER, ENCODING_UTF16, src, len, dst, dst_len);
+}
+
+size_t ucdn_uppercase_utf8(const uint8_t *src, size_t len,
+                           uint8_t *dst, size_t dst_len)
+{
+    return case_convert(CASE_UPPER, ENCODING_UTF8, src, len, dst, dst_len);
+}
+
+/*
+ * Case folding
+ *
+ * The default case foldings map each codepoint on its own, so they
+ * share case_convert() with the case mappings. NFKC_Casefold maps each
+ * codepoint and normalizes the result to NFC.
+ */
+
+static int casefold_mapping(int folding)
+{
+    return folding == UCDN_CASEFOLD_SIMPLE ? CASE_FOLD_SIMPLE : CASE_FOLD;
+}
+
+static size_t casefold_nfkc(int encoding, const void *src, size_t len,
+                            void *dst, size_t dst_len)
+{
+    Normalizer n;
+    size_t i = 0;
+    uint32_t mapped[NFKC_CF_MAX];
+    int j, mapped_len;
+
+    norm_init(&n, UCDN_NORMALIZATION_NFC, encoding, dst, dst_len);
+    while (i < len) {
+        n.pos = i;
+        mapped_len = ucdn_nfkc_casefold(norm_read(&n, src, len, &i), mapped);
+        for (j = 0; j < mapped_len; j++)
+            norm_add(&n, mapped[j]);
+        if (n.overflow)
+            i = norm_long_run(&n, encoding, 1, src, len);
+    }
+    return norm_finish(&n);
+}
+
+static size_t casefold(int folding, int encoding, const void *src,
+                       size_t len, void *dst, size_t dst_len)
+{
+    if (folding == UCDN_CASEFOLD_NFKC)
+        return casefold_nfkc(encoding, src, len, dst, dst_len);
+    else if (folding == UCDN_CASEFOLD_FULL || folding == UCDN_CASEFOLD_SIMPLE)
+        return case_convert(casefold_mapping(folding), encoding, src, len,
+                            dst, dst_len);
+    return UCDN_NORMALIZE_ERROR;
+}
+
+size_t ucdn_casefold(int folding, const uint32_t *src, size_t len,
+                     uint32_t *dst, size_t dst_len)
+{
+    return casefold(folding, ENCODING_UTF32, src, len, dst, dst_len);
+}
+
+size_t ucdn_casefold_utf16(int folding, const uint16_t *src, size_t len,
+                           uint16_t *dst, size_t dst_len)
+{
+    return casefold(folding, ENCODING_UTF16, src, len, dst, dst_len);
+}
+
+size_t ucdn_casefold_utf8(int folding, const uint8_t *src, size_t len,
+                          uint8_t *dst, size_t dst_len)
+{
+    return casefold(folding, ENCODING_UTF8, src, len, dst, dst_len);
+}
+
+/*
+ * Folded hashing, FNV-1a over the UTF-8 encoding of the folded text.
+ * The folded codepoints are hashed as they are produced, NFKC_Casefold
+ * goes through a normalizer that hashes its output instead of storing
+ * it (ENCODING_HASH), so no buffer is needed.
+ */
+
+static uint32_t code_unit(int encoding, const void *src, size_t pos)
+{
+    if (encoding == ENCODING_UTF32)
+        return ((const uint32_t *)src)[pos];
+    else if (encoding == ENCODING_UTF16)
+        return ((const uint16_t *)src)[pos];
+    else
+        return ((const uint8_t *)src)[pos];
+}
+
+static uint32_t hash_nfkc(int encoding, const void *src, size_t len,
+                          uint32_t hash)
+{
+    Normalizer n;
+    size_t i = 0, start;
+    uint32_t code, mapped[NFKC_CF_MAX];
+    int j, mapped_len;
+
+    norm_init(&n, UCDN_NORMALIZATION_NFC, ENCODING_HASH, &hash, (size_t)-1);
+    while (i < len) {
+        start = i;
+        code = read_code(encoding, src, len, &i);
+
+        /* nothing composes with ASCII followed by ASCII */
+        if (code < 0x80 && (i == len || code_unit(encoding, src, i) < 0x80)) {
+            norm_flush(&n);
+            code ^= (code - 'A' < 26) << 5;
+            hash = (hash ^ code) * FNV_PRIME;
+            continue;
+        }
+
+        n.pos = start;
+        mapped_len = ucdn_nfkc_casefold(code, mapped);
+        for (j = 0; j < mapped_len; j++)
+            norm_add(&n, mapped[j]);
+        if (n.overflow)
+            i = norm_long_run(&n, encoding, 1, src, len);
+    }
+    norm_flush(&n);
+    return hash;
+}
+
+static uint32_t hash_fold(int folding, int encoding, const void *src,
+                          size_t len, uint32_t hash)
+{
+    size_t i = 0;
+    uint32_t code, mapped[3];
+    int j, mapped_len, mapping = casefold_mapping(folding);
+
+    if (folding == UCDN_CASEFOLD_NFKC)
+        return hash_nfkc(encoding, src, len, hash);
+
+    while (i < len) {
+        code = read_code(encoding, src, len, &i);
+        if (code < 0x80) {
+            code ^= (code - 'A' < 26) << 5;
+            hash = (hash ^ code) * FNV_PRIME;
+            continue;
+        }
+        mapped_len = case_full(code, mapping, mapped);
+        for (j = 0; j < mapped_len; j++)
+            hash = hash_code(hash, mapped[j]);
+    }
+    return hash;
+}
+
+uint32_t ucdn_casefold_hash(int folding, const uint32_t *src, size_t len,
+                            uint32_t hash)
+{
+    return hash_fold(folding, ENCODING_UTF32, src, len, hash);
+}
+
+uint32_t ucdn_casefold_hash_utf16(int folding, const uint16_t *src,
+                                  size_t len, uint32_t hash)
+{
+    return hash_fold(folding, ENCODING_UTF16, src, len, hash);
+}
+
+uint32_t ucdn_casefold_hash_utf8(int folding, const uint8_t *src, size_t len,
+                                 uint32_t hash)
+{
+    return hash_fold(folding, ENCODING_UTF8, src, len, hash);
+}
+
+/*
+ * Line breaking (UAX#14)
+ *
+ * The rules are those of UAX#14 revision 43, for Unicode 12.0.0 like the
+ * database, so LB30 does not depend on the East Asian width yet.
+ *
+ * A pair table implementation as described in section 7 of UAX#14. The
+ * classes are resolved as in LB1, except for CB, which LB20 breaks
+ * around. The pair table covers the rules between LB11 and LB30b, the
+ * hard breaks, spaces, combining marks and the rules that need more
+ * context than a pair of classes are handled in lb_next(). Numbers are
+ * tailored as in example 7 of section 8.2, like in LineBreakTest.txt.
+ */
+
+/* classes that are not in the pair table are numbered after it */
+#define LB_EB 29
+#define LB_EM 30
+#define LB_CB 31
+#define LB_ZWJ 32
+#define LB_BK 33 /* BK and the following classes are hard breaks or SP */
+#define LB_CR 34
+#define LB_LF 35
+#define LB_SP 36
+#define LB_SA 37
+
+/* LB1, complex context dependent classes are resolved in lb_class() */
+static const unsigned char lb_classes[] = {
+    UCDN_LINEBREAK_CLASS_OP, UCDN_LINEBREAK_CLASS_CL,
+    UCDN_LINEBREAK_CLASS_CP, UCDN_LINEBREAK_CLASS_QU,
+    UCDN_LINEBREAK_CLASS_GL, UCDN_LINEBREAK_CLASS_NS,
+    UCDN_LINEBREAK_CLASS_EX, UCDN_LINEBREAK_CLASS_SY,
+    UCDN_LINEBREAK_CLASS_IS, UCDN_LINEBREAK_CLASS_PR,
+    UCDN_LINEBREAK_CLASS_PO, UCDN_LINEBREAK_CLASS_NU,
+    UCDN_LINEBREAK_CLASS_AL, UCDN_LINEBREAK_CLASS_HL,
+    UCDN_LINEBREAK_CLASS_ID, UCDN_LINEBREAK_CLASS_IN,
+    UCDN_LINEBREAK_CLASS_HY, UCDN_LINEBREAK_CLASS_BA,
+    UCDN_LINEBREAK_CLASS_BB, UCDN_LINEBREAK_CLASS_B2,
+    UCDN_LINEBREAK_CLASS_ZW, UCDN_LINEBREAK_CLASS_CM,
+    UCDN_LINEBREAK_CLASS_WJ, UCDN_LINEBREAK_CLASS_H2,
+    UCDN_LINEBREAK_CLASS_H3, UCDN_LINEBREAK_CLASS_JL,
+    UCDN_LINEBREAK_CLASS_JV, UCDN_LINEBREAK_CLASS_JT,
+    UCDN_LINEBREAK_CLASS_RI,
+    UCDN_LINEBREAK_CLASS_AL, /* AI */
+    LB_BK, LB_CB,
+    UCDN_LINEBREAK_CLASS_NS, /* CJ */
+    LB_CR, LB_LF,
+    LB_BK, /* NL */
+    LB_SA,
+    UCDN_LINEBREAK_CLASS_AL, /* SG */
+    LB_SP,
+    UCDN_LINEBREAK_CLASS_AL, /* XX */
+    LB_ZWJ, LB_EB, LB_EM
+};
+
+/*
+ * Break actions for a pair of the class before and after a position,
+ * spaces in between are skipped:
+ * '^' no break, even if spaces are in between
+ * '%' no break, unless spaces are in between
+ * '_' break
+ * The ZW row is never used, as LB8 applies first.
+ */
+static const char lb_pairs[32][33] = {
+    /*  OCCQGNESIPPNAHIIHBBBZCWHHJJJREEC */
+    "^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^", /* OP */
+    "_^^%%^^^^_______%%____^_________", /* CL */
+    "_^^%%^^^^__%%%__%%____^_________", /* CP */
+    "^^^%%%^^^%%%%%%%%%%%%%^%%%%%%%%%", /* QU */
+    "%^^%%%^^^%%%%%%%%%%%%%^%%%%%%%%%", /* GL */
+    "_^^%%%^^^_______%%____^_________", /* NS */
+    "_^^%%%^^^______%%%____^_________", /* EX */
+    "_^^%%%^^^____%__%%____^_________", /* SY */
+    "_^^%%%^^^___%%__%%____^_________", /* IS */
+    "_^^%%%^^^__%%%%_%%____^%%%%%_%%_", /* PR */
+    "_^^%%%^^^__%%%__%%____^_________", /* PO */
+    "%^^%%%^^^__%%%_%%%____^_________", /* NU */
+    "%^^%%%^^^%%%%%_%%%____^_________", /* AL */
+    "%^^%%%^^^%%%%%_%%%____^_________", /* HL */
+    "_^^%%%^^^_%____%%%____^_________", /* ID */
+    "_^^%%%^^^______%%%____^_________", /* IN */
+    "_^^%_%^^^__%____%%____^_________", /* HY */
+    "_^^%_%^^^_______%%____^_________", /* BA */
+    "%^^%%%^^^%%%%%%%%%%%%%^%%%%%%%%_", /* BB */
+    "_^^%%%^^^_______%%_^__^_________", /* B2 */
+    "_^^%%%^^^_______%%____^_________", /* ZW */
+    "_^^%%%^^^_______%%____^_________", /* CM */
+    "%^^%%%^^^%%%%%%%%%%%%%^%%%%%%%%%", /* WJ */
+    "_^^%%%^^^_%____%%%____^___%%____", /* H2 */
+    "_^^%%%^^^_%____%%%____^____%____", /* H3 */
+    "_^^%%%^^^_%____%%%____^%%%%_____", /* JL */
+    "_^^%%%^^^_%____%%%____^___%%____", /* JV */
+    "_^^%%%^^^_%____%%%____^____%____", /* JT */
+    "_^^%%%^^^_______%%____^_________", /* RI */
+    "_^^%%%^^^_%____%%%____^_______%_", /* EB */
+    "_^^%%%^^^_%____%%%____^_________", /* EM */
+    "_^^%%_^^^_____________^_________"  /* CB */
+};
+
+/* position in a number, for the tailoring of LB25 */
+#define LB_NUMBER_NONE 0
+#define LB_NUMBER_DIGITS 1 /* NU (NU | SY | IS)* */
+#define LB_NUMBER_CLOSE 2 /* NU (NU | SY | IS)* (CL | CP) */
+
+/*
+ * (PR | PO) × OP only holds if a number follows, so the break is
+ * tentative until the next class is known.
+ */
+#define LB_TENTATIVE 1
+#define LB_JOIN 2
+
+typedef struct {
+    int prev; /* class of the previous codepoint */
+    int base; /* class of the last codepoint that is not a space or CM */
+    int spaces; /* spaces follow base */
+    int ri; /* parity of the regional indicators in a row up to base */
+    int number;
+    int hyphen; /* base is HY or BA after HL (LB21a) */
+    int open; /* the break before base is tentative */
+    int event; /* LB_TENTATIVE or LB_JOIN for the last codepoint */
+} LineBreaker;
+
+/* the state at the start of text and after a mandatory break */
+static void lb_init(LineBreaker *lb)
+{
+    lb->prev = LB_BK;
+    lb->base = UCDN_LINEBREAK_CLASS_CM;
+    lb->spaces = 0;
+    lb->ri = 0;
+    lb->number = LB_NUMBER_NONE;
+    lb->hyphen = 0;
+    lb->open = 0;
+    lb->event = 0;
+}
+
+static int lb_class(uint32_t code, int cls)
+{
+    cls = lb_classes[cls];
+    if (cls == LB_SA) {
+        int category = ucdn_get_general_category(code);
+
+        if (category == UCDN_GENERAL_CATEGORY_MN ||
+                category == UCDN_GENERAL_CATEGORY_MC)
+            return UCDN_LINEBREAK_CLASS_CM;
+        return UCDN_LINEBREAK_CLASS_AL;
+    }
+    return cls;
+}
+
+/* make cls the class that the following pairs are looked up with */
+static void lb_set_base(LineBreaker *lb, int cls)
+{
+    int base = lb->base, spaces = lb->spaces;
+
+    lb->hyphen = base == UCDN_LINEBREAK_CLASS_HL && !spaces &&
+        (cls == UCDN_LINEBREAK_CLASS_HY || cls == UCDN_LINEBREAK_CLASS_BA);
+
+    if (cls == UCDN_LINEBREAK_CLASS_NU)
+        lb->number = LB_NUMBER_DIGITS;
+    else if (lb->number != LB_NUMBER_DIGITS || spaces)
+        lb->number = LB_NUMBER_NONE;
+    else if (cls == UCDN_LINEBREAK_CLASS_CL ||
+             cls == UCDN_LINEBREAK_CLASS_CP)
+        lb->number = LB_NUMBER_CLOSE;
+    else if (cls != UCDN_LINEBREAK_CLASS_SY &&
+             cls != UCDN_LINEBREAK_CLASS_IS)
+        lb->number = LB_NUMBER_NONE;
+
+    if (cls != UCDN_LINEBREAK_CLASS_RI)
+        lb->ri = 0;
+    else if (base == UCDN_LINEBREAK_CLASS_RI && !spaces)
+        lb->ri = !lb->ri;
+    else
+        lb->ri = 1;
+
+    /*
+     * After a hard break, only spaces can precede the next pair, the
+     * CM row has just the rules that apply to them (LB11 and LB13).
+     */
+    lb->base = cls >= LB_BK ? UCDN_LINEBREAK_CLASS_CM : cls;
+    lb->spaces = 0;
+}
+
+/* rules for the pair of base and cls */
+static int lb_pair(LineBreaker *lb, int cls)
+{
+    int base = lb->base;
+    char action;
+
+    action = lb_pairs[base][cls];
+    if (action == '^' || (action == '%' && !lb->spaces))
+        return UCDN_LINEBREAK_NONE;
+    if (lb->spaces)
+        return UCDN_LINEBREAK_ALLOWED;
+
+    /* LB21a, LB25 and LB30a */
+    if (lb->hyphen && cls != LB_CB)
+        return UCDN_LINEBREAK_NONE;
+    if (lb->number == LB_NUMBER_DIGITS && cls == UCDN_LINEBREAK_CLASS_NU)
+        return UCDN_LINEBREAK_NONE;
+    if (lb->number != LB_NUMBER_NONE && (cls == UCDN_LINEBREAK_CLASS_PO ||
+                                         cls == UCDN_LINEBREAK_CLASS_PR))
+        return UCDN_LINEBREAK_NONE;
+    if (base == UCDN_LINEBREAK_CLASS_RI && cls == UCDN_LINEBREAK_CLASS_RI &&
+            lb->ri)
+        return UCDN_LINEBREAK_NONE;
+    if ((base == UCDN_LINEBREAK_CLASS_PR || base == UCDN_LINEBREAK_CLASS_PO) &&
+            cls == UCDN_LINEBREAK_CLASS_OP)
+        lb->event = LB_TENTATIVE;
+    return UCDN_LINEBREAK_ALLOWED;
+}
+
+/* Get the break before a codepoint of class cls and advance past it. */
+static int lb_next(LineBreaker *lb, int cls)
+{
+    int prev = lb->prev, action = -1;
+
+    lb->prev = cls;
+    lb->event = 0;
+
+    /* LB4-LB8a */
+    if (prev == LB_BK || prev == LB_LF || (prev == LB_CR && cls != LB_LF))
+        action = UCDN_LINEBREAK_MANDATORY;
+    else if (cls >= LB_BK || cls == UCDN_LINEBREAK_CLASS_ZW)
+        action = UCDN_LINEBREAK_NONE;
+    else if (lb->base == UCDN_LINEBREAK_CLASS_ZW)
+        action = UCDN_LINEBREAK_ALLOWED;
+    else if (prev == LB_ZWJ)
+        action = UCDN_LINEBREAK_NONE;
+
+    if (cls == LB_SP) {
+        lb->spaces = 1;
+        lb->open = 0;
+        return action;
+    }
+
+    /* LB9 and LB10 */
+    if (cls == UCDN_LINEBREAK_CLASS_CM || cls == LB_ZWJ) {
+        if (prev < LB_BK && prev != UCDN_LINEBREAK_CLASS_ZW)
+            return UCDN_LINEBREAK_NONE;
+        cls = UCDN_LINEBREAK_CLASS_AL;
+    }
+
+    if (action < 0)
+        action = lb_pair(lb, cls);
+    if (lb->open && cls == UCDN_LINEBREAK_CLASS_NU)
+        lb->event = LB_JOIN;
+    lb->open = lb->event == LB_TENTATIVE;
+    lb_set_base(lb, cls);
+    return action;
+}
+
+void ucdn_linebreaks(const uint32_t *src, uint8_t *breaks, size_t len)
+{
+    LineBreaker lb;
+    size_t i, tentative = 0;
+
+    if (len == 0)
+        return;
+
+    /* the classes are looked up in bulk and replaced with the breaks */
+    get_linebreak_classes(src, breaks, len);
+    lb_init(&lb);
+    lb_next(&lb, lb_class(src[0], breaks[0]));
+    for (i = 1; i < len; i++) {
+        breaks[i - 1] = (uint8_t)lb_next(&lb, lb_class(src[i], breaks[i]));
+        if (lb.event == LB_TENTATIVE)
+            tentative = i - 1;
+        else if (lb.event == LB_JOIN)
+            breaks[tentative] = UCDN_LINEBREAK_NONE;
+    }
+    breaks[len - 1] = UCDN_LINEBREAK_MANDATORY;
+}
+
+/*
+ * After a break that is not tentative, the state of the line breaker
+ * only depends on the codepoint following it, it is the same as at the
+ * start of the text. Such breaks are the points where an update can
+ * resume and where it can stop, once the breaks agree with the old
+ * ones again.
+ */
+static int lb_resumable(const uint32_t *src, const uint8_t *breaks,
+                        size_t pos)
+{
+    uint32_t code = src[pos];
+
+    return breaks[pos - 1] != UCDN_LINEBREAK_NONE &&
+        lb_class(code, ucdn_get_linebreak_class(code)) !=
+        UCDN_LINEBREAK_CLASS_OP;
+}
+
+size_t ucdn_linebreaks_update(const uint32_t *src, uint8_t *breaks,
+                              size_t len, size_t start, size_t end)
+{
+    LineBreaker lb;
+    size_t i, tentative = 0;
+    uint32_t code;
+    int action;
+
+    if (len == 0)
+        return 0;
+    if (end > len)
+        end = len;
+    if (start > end)
+        start = end;
+
+    /* the break before start may change, so the one before that is used */
+    i = start > 0 ? start - 1 : 0;
+    while (i > 0 && !lb_resumable(src, breaks, i))
+        i--;
+
+    lb_init(&lb);
+    lb_next(&lb, lb_class(src[i], ucdn_get_linebreak_class(src[i])));
+    for (i++; i < len; i++) {
+        code = src[i];
+        action = lb_next(&lb, lb_class(code, ucdn_get_linebreak_class(code)));
+        if (lb.event == LB_JOIN)
+            breaks[tentative] = UCDN_LINEBREAK_NONE;
+        else if (lb.event == LB_TENTATIVE)
+            tentative = i - 1;
+        else if (i > end && action != UCDN_LINEBREAK_NONE &&
+                 breaks[i - 1] == action)
+            return i - 1;
+        breaks[i - 1] = (uint8_t)action;
+    }
+    breaks[len - 1] = UCDN_LINEBREAK_MANDATORY;
+    return len;
+}
+
+/*
+ * Grapheme clusters (UAX#29)
+ *
+ * The rules GB3 to GB9b only depend on the pair of classes around a
+ * position and are kept as a mask of the classes that do not break
+ * after each class. GB11 and GB12/GB13 need a little state. None of the
+ * rules look past the start of the cluster, so iterating can start at
+ * any boundary.
+ */
+
+#define GB_BIT(cls) (1 << UCDN_GRAPHEME_BREAK_##cls)
+#define GB_EXTEND (GB_BIT(EXTEND) | GB_BIT(ZWJ) | GB_BIT(SPACINGMARK))
+#define GB_EXTENDED_PICTOGRAPHIC 0x10 /* flag in the segment properties */
+
+static const unsigned short gb_pairs[] = {
+    GB_EXTEND, /* Other */
+    GB_BIT(LF), /* CR */
+    0, /* LF */
+    0, /* Control */
+    GB_EXTEND, /* Extend */
+    GB_EXTEND, /* ZWJ */
+    GB_EXTEND, /* Regional_Indicator, pairs are handled in gb_next() */
+    0x3fff & ~(GB_BIT(CR) | GB_BIT(LF) | GB_BIT(CONTROL)), /* Prepend */
+    GB_EXTEND, /* SpacingMark */
+    GB_EXTEND | GB_BIT(L) | GB_BIT(V) | GB_BIT(LV) | GB_BIT(LVT), /* L */
+    GB_EXTEND | GB_BIT(V) | GB_BIT(T), /* V */
+    GB_EXTEND | GB_BIT(T), /* T */
+    GB_EXTEND | GB_BIT(V) | GB_BIT(T), /* LV */
+    GB_EXTEND | GB_BIT(T) /* LVT */
+};
+
+/* position in an emoji sequence, for GB11 */
+#define GB_EMOJI_NONE 0
+#define GB_EMOJI_BASE 1 /* ExtPict Extend* */
+#define GB_EMOJI_ZWJ 2 /* ExtPict Extend* ZWJ */
+
+typedef struct {
+    int prev; /* class of the previous codepoint */
+    int emoji;
+    int ri; /* parity of the regional indicators in a row */
+} GraphemeBreaker;
+
+/* the state at the start of text, which breaks like after a control */
+static void gb_init(GraphemeBreaker *gb)
+{
+    gb->prev = UCDN_GRAPHEME_BREAK_CONTROL;
+    gb->emoji = GB_EMOJI_NONE;
+    gb->ri = 0;
+}
+
+/* the state after an ASCII character, without a table lookup */
+static void gb_set_ascii(GraphemeBreaker *gb, uint32_t code)
+{
+    if (code == '\r')
+        gb->prev = UCDN_GRAPHEME_BREAK_CR;
+    else if (code == '\n')
+        gb->prev = UCDN_GRAPHEME_BREAK_LF;
+    else if (code < 0x20 || code == 0x7f)
+        gb->prev = UCDN_GRAPHEME_BREAK_CONTROL;
+    else
+        gb->prev = UCDN_GRAPHEME_BREAK_OTHER;
+    gb->emoji = GB_EMOJI_NONE;
+    gb->ri = 0;
+}
+
+/*
+ * Check for a boundary before a codepoint with the segment properties
+ * props and advance past it.
+ */
+static int gb_next(GraphemeBreaker *gb, int props)
+{
+    int prev = gb->prev, cls = props & 0xf, boundary;
+
+    boundary = !((gb_pairs[prev] >> cls) & 1);
+    if (gb->emoji == GB_EMOJI_ZWJ && (props & GB_EXTENDED_PICTOGRAPHIC))
+        boundary = 0;
+    if (prev == UCDN_GRAPHEME_BREAK_REGIONAL_INDICATOR &&
+            cls == UCDN_GRAPHEME_BREAK_REGIONAL_INDICATOR && gb->ri)
+        boundary = 0;
+
+    if (props & GB_EXTENDED_PICTOGRAPHIC)
+        gb->emoji = GB_EMOJI_BASE;
+    else if (gb->emoji == GB_EMOJI_BASE && cls == UCDN_GRAPHEME_BREAK_ZWJ)
+        gb->emoji = GB_EMOJI_ZWJ;
+    else if (gb->emoji != GB_EMOJI_BASE || cls != UCDN_GRAPHEME_BREAK_EXTEND)
+        gb->emoji = GB_EMOJI_NONE;
+    if (cls != UCDN_GRAPHEME_BREAK_REGIONAL_INDICATOR)
+        gb->ri = 0;
+    else
+        gb->ri = prev == cls ? !gb->ri : 1;
+    gb->prev = cls;
+    return boundary;
+}
+
+int ucdn_get_grapheme_break(uint32_t code)
+{
+    return get_segment_props(code) & 0xf;
+}
+
+int ucdn_get_extended_pictographic(uint32_t code)
+{
+    return (get_segment_props(code) & GB_EXTENDED_PICTOGRAPHIC) != 0;
+}
+
+static size_t grapheme_next(int encoding, const void *src, size_t len,
+                            size_t pos)
+{
+    GraphemeBreaker gb;
+    size_t start;
+    uint32_t code, next;
+
+    if (pos >= len)
+        return len;
+
+    /* ASCII followed by ASCII is a cluster of its own, except CR LF */
+    code = code_unit(encoding, src, pos);
+    if (code < 0x80) {
+        if (pos + 1 == len)
+            return len;
+        next = code_unit(encoding, src, pos + 1);
+        if (next < 0x80)
+            return pos + 1 + (code == '\r' && next == '\n');
+    }
+
+    gb_init(&gb);
+    gb_next(&gb, get_segment_props(read_code(encoding, src, len, &pos)));
+    while (pos < len) {
+        start = pos;
+        code = read_code(encoding, src, len, &pos);
+        if (gb_next(&gb, get_segment_props(code)))
+            return start;
+    }
+    return len;
+}
+
+size_t ucdn_next_grapheme(const uint32_t *src, size_t len, size_t pos)
+{
+    return grapheme_next(ENCODING_UTF32, src, len, pos);
+}
+
+size_t ucdn_next_grapheme_utf16(const uint16_t *src, size_t len, size_t pos)
+{
+    return grapheme_next(ENCODING_UTF16, src, len, pos);
+}
+
+size_t ucdn_next_grapheme_utf8(const uint8_t *src, size_t len, size_t pos)
+{
+    return grapheme_next(ENCODING_UTF8, src, len, pos);
+}
+
+/*
+ * Count a block of 8 ASCII code units after an ASCII code unit or at the
+ * start of the text, without any table lookups, and continue the count
+ * loop. Each code unit starts a cluster, unless it is the LF of a
+ * CR LF. The tests have no branches, so that they can be vectorized.
+ */
+#define GB_COUNT_BLOCK(gb, src, len, i, count) \
+    if ((i) + 8 <= (len) && ((i) == 0 || (src)[(i) - 1] < 0x80)) { \
+        int above_ = 0, crlf_, j_; \
+        for (j_ = 0; j_ < 8; j_++) \
+            above_ |= (src)[(i) + j_] >= 0x80; \
+        if (!above_) { \
+            crlf_ = (i) > 0 && (src)[(i) - 1] == '\r' && (src)[i] == '\n'; \
+            for (j_ = 1; j_ < 8; j_++) \
+                crlf_ += ((src)[(i) + j_ - 1] == '\r') & \
+                    ((src)[(i) + j_] == '\n'); \
+            (i) += 8; \
+            (count) += 8 - crlf_; \
+            gb_set_ascii(&(gb), (src)[(i) - 1]); \
+            continue; \
+        } \
+    }
+
+size_t ucdn_count_graphemes(const uint32_t *src, size_t len)
+{
+    GraphemeBreaker gb;
+    size_t i = 0, count = 0;
+
+    gb_init(&gb);
+    while (i < len) {
+        if (src[i] < 0x80)
+            GB_COUNT_BLOCK(gb, src, len, i, count);
+        count += gb_next(&gb, get_segment_props(src[i]));
+        i++;
+    }
+    return count;
+}
+
+size_t ucdn_count_graphemes_utf16(const uint16_t *src, size_t len)
+{
+    GraphemeBreaker gb;
+    size_t i = 0, count = 0;
+    uint32_t code;
+
+    gb_init(&gb);
+    while (i < len) {
+        if (src[i] < 0x80)
+            GB_COUNT_BLOCK(gb, src, len, i, count);
+        code = read_utf16(src, len, &i);
+        count += gb_next(&gb, get_segment_props(code));
+    }
+    return count;
+}
+
+size_t ucdn_count_graphemes_utf8(const uint8_t *src, size_t len)
+{
+    GraphemeBreaker gb;
+    size_t i = 0, count = 0;
+    uint32_t code;
+
+    gb_init(&gb);
+    while (i < len) {
+        if (src[i] < 0x80)
+            GB_COUNT_BLOCK(gb, src, len, i, count);
+        code = read_utf8(src, len, &i);
+        count += gb_next(&gb, get_segment_props(code));
+    }
+    return count;
+}
+
+/*
+ * Word and sentence boundaries (UAX#29)
+ *
+ * Most rules only look at the classes around a position, ignoring
+ * Extend, Format and ZWJ (WB4, SB5). The rules that look ahead, WB6,
+ * WB7b, WB12 and SB8, leave the position before the text they look at
+ * undecided until it has been seen, and no other position can be
+ * undecided meanwhile. So there is never more than one pending boundary
+ * and no text has to be kept.
+ */
+
+#define SEGMENT_WORD_BREAK(props) (((props) >> 5) & 0x1f)
+#define SEGMENT_SENTENCE_BREAK(props) ((props) >> 10)
+
+#define SEG_SOT -1 /* class of the last codepoint at the start of text */
+
+/* outcomes of a position */
+#define SEG_NONE 0
+#define SEG_BREAK 1
+#define SEG_PENDING 2
+
+typedef UCDNSegmenter Segmenter;
+
+int ucdn_get_word_break(uint32_t code)
+{
+    return SEGMENT_WORD_BREAK(get_segment_props(code));
+}
+
+int ucdn_get_sentence_break(uint32_t code)
+{
+    return SEGMENT_SENTENCE_BREAK(get_segment_props(code));
+}
+
+#define WB_BIT(cls) (1UL << UCDN_WORD_BREAK_##cls)
+#define WB_AHLETTER (WB_BIT(ALETTER) | WB_BIT(HEBREW_LETTER))
+#define WB_MIDNUMLETQ (WB_BIT(MIDNUMLET) | WB_BIT(SINGLE_QUOTE))
+#define WB_NEWLINES (WB_BIT(CR) | WB_BIT(LF) | WB_BIT(NEWLINE))
+#define WB_IGNORED (WB_BIT(EXTEND) | WB_BIT(FORMAT) | WB_BIT(ZWJ))
+#define WB_WORD (WB_AHLETTER | WB_BIT(NUMERIC) | WB_BIT(EXTENDNUMLET))
+
+/* WB5, WB8-WB10 and WB13-WB13b, the classes that continue a word */
+static const unsigned long wb_pairs[] = {
+    0, 0, 0, 0, 0, 0, 0, 0, /* Other to Format */
+    WB_BIT(KATAKANA) | WB_BIT(EXTENDNUMLET), /* Katakana */
+    WB_WORD, /* Hebrew_Letter */
+    WB_WORD, /* ALetter */
+    0, 0, 0, 0, 0, /* Single_Quote to MidNum */
+    WB_WORD, /* Numeric */
+    WB_WORD | WB_BIT(KATAKANA), /* ExtendNumLet */
+    0 /* WSegSpace */
+};
+
+/*
+ * Rules for the pair of the last codepoint that is not ignored and cls.
+ * The rules that need the codepoint after cls set the classes it must
+ * have in wait.
+ */
+static int wb_pair(Segmenter *s, int cls)
+{
+    int prev = s->prev;
+    unsigned long prev_bit = 1UL << prev, bit = 1UL << cls;
+
+    if (wb_pairs[prev] & bit)
+        return SEG_NONE;
+
+    /* WB6, WB7a, WB7b and WB12 */
+    if (prev == UCDN_WORD_BREAK_HEBREW_LETTER &&
+            cls == UCDN_WORD_BREAK_SINGLE_QUOTE) {
+        s->wait = WB_AHLETTER;
+        return SEG_NONE;
+    }
+    if ((prev_bit & WB_AHLETTER) &&
+            (bit & (WB_BIT(MIDLETTER) | WB_MIDNUMLETQ))) {
+        s->wait = WB_AHLETTER;
+        return SEG_PENDING;
+    }
+    if (prev == UCDN_WORD_BREAK_HEBREW_LETTER &&
+            cls == UCDN_WORD_BREAK_DOUBLE_QUOTE) {
+        s->wait = WB_BIT(HEBREW_LETTER);
+        return SEG_PENDING;
+    }
+    if (prev == UCDN_WORD_BREAK_NUMERIC &&
+            (bit & (WB_BIT(MIDNUM) | WB_MIDNUMLETQ))) {
+        s->wait = WB_BIT(NUMERIC);
+        return SEG_PENDING;
+    }
+
+    /* WB15 and WB16 */
+    if (prev == UCDN_WORD_BREAK_REGIONAL_INDICATOR &&
+            cls == UCDN_WORD_BREAK_REGIONAL_INDICATOR && s->ri)
+        return SEG_NONE;
+    return SEG_BREAK;
+}
+
+/*
+ * Get the outcome of the position before a codepoint with the segment
+ * properties props and advance past it. If a pending position is
+ * decided, its outcome is stored in resolved.
+ */
+static int wb_next(Segmenter *s, int props, int *resolved)
+{
+    int cls = SEGMENT_WORD_BREAK(props), last = s->last, action = -1;
+    unsigned long bit = 1UL << cls, wait = s->wait;
+
+    s->last = cls;
+
+    /* WB1-WB4 */
+    if (last == SEG_SOT)
+        action = SEG_NONE;
+    else if (last == UCDN_WORD_BREAK_CR && cls == UCDN_WORD_BREAK_LF)
+        action = SEG_NONE;
+    else if (((1UL << last) | bit) & WB_NEWLINES)
+        action = SEG_BREAK;
+    else if (bit & WB_IGNORED)
+        return SEG_NONE;
+    else if (last == UCDN_WORD_BREAK_ZWJ && (props & GB_EXTENDED_PICTOGRAPHIC))
+        action = SEG_NONE;
+    else if (last == UCDN_WORD_BREAK_WSEGSPACE &&
+             cls == UCDN_WORD_BREAK_WSEGSPACE)
+        action = SEG_NONE;
+
+    /* WB6, WB7b and WB12 are decided, WB7, WB7c and WB11 apply */
+    s->wait = 0;
+    if (s->pending) {
+        s->pending = 0;
+        *resolved = bit & wait ? SEG_NONE : SEG_BREAK;
+    }
+    if (action < 0)
+        action = bit & wait ? SEG_NONE : wb_pair(s, cls);
+
+    if (cls != UCDN_WORD_BREAK_REGIONAL_INDICATOR)
+        s->ri = 0;
+    else
+        s->ri = s->prev == cls ? !s->ri : 1;
+    s->prev = cls;
+    return action;
+}
+
+/* position in a sentence, for the rules after a full stop */
+#define SB_TEXT 0
+#define SB_TERM 1 /* SATerm Close* */
+#define SB_SPACE 2 /* SATerm Close* Sp+ */
+#define SB_LOOKAHEAD 3 /* ATerm Close* Sp* (not SB8 stop)+, pending */
+
+#define SB_BIT(cls) (1UL << UCDN_SENTENCE_BREAK_##cls)
+#define SB_PARASEP (SB_BIT(SEP) | SB_BIT(CR) | SB_BIT(LF))
+#define SB_SATERM (SB_BIT(ATERM) | SB_BIT(STERM))
+#define SB_IGNORED (SB_BIT(EXTEND) | SB_BIT(FORMAT))
+/* the classes that end the lookahead of SB8 */
+#define SB_STOP (SB_BIT(OLETTER) | SB_BIT(UPPER) | SB_BIT(LOWER) | \
+    SB_PARASEP | SB_SATERM)
+
+/* rules for the position after SATerm Close* Sp* */
+static int sb_after_term(Segmenter *s, int cls)
+{
+    unsigned long bit = 1UL << cls;
+    int prev = s->prev;
+
+    /* SB8a-SB10 */
+    if ((cls == UCDN_SENTENCE_BREAK_CLOSE && s->state == SB_TERM) ||
+            (bit & (SB_BIT(SP) | SB_PARASEP | SB_BIT(SCONTINUE) | SB_SATERM)))
+        return SEG_NONE;
+    if (s->term != UCDN_SENTENCE_BREAK_ATERM)
+        return SEG_BREAK;
+
+    /* SB6-SB8 */
+    if (prev == UCDN_SENTENCE_BREAK_ATERM &&
+            (cls == UCDN_SENTENCE_BREAK_NUMERIC ||
+             (cls == UCDN_SENTENCE_BREAK_UPPER && s->wait)))
+        return SEG_NONE;
+    if (cls == UCDN_SENTENCE_BREAK_LOWER)
+        return SEG_NONE;
+    if (bit & SB_STOP)
+        return SEG_BREAK;
+    return SEG_PENDING;
+}
+
+/* Like wb_next(), for sentences. */
+static int sb_next(Segmenter *s, int props, int *resolved)
+{
+    int cls = SEGMENT_SENTENCE_BREAK(props), last = s->last, action;
+    unsigned long bit = 1UL << cls;
+
+    s->last = cls;
+
+    /* SB1-SB5 */
+    if (last == SEG_SOT) {
+        action = SEG_NONE;
+    } else if (last == UCDN_SENTENCE_BREAK_CR &&
+               cls == UCDN_SENTENCE_BREAK_LF) {
+        action = SEG_NONE;
+    } else if ((1UL << last) & SB_PARASEP) {
+        action = SEG_BREAK;
+        s->state = SB_TEXT;
+    } else if (bit & SB_IGNORED) {
+        return SEG_NONE;
+    } else if (s->state == SB_LOOKAHEAD) {
+        action = SEG_NONE;
+        if (bit & SB_STOP) {
+            *resolved = cls == UCDN_SENTENCE_BREAK_LOWER ?
+                SEG_NONE : SEG_BREAK;
+            s->pending = 0;
+            s->state = SB_TEXT;
+        }
+    } else if (s->state != SB_TEXT) {
+        action = sb_after_term(s, cls);
+    } else {
+        action = SEG_NONE;
+    }
+
+    if (s->state == SB_TERM || s->state == SB_SPACE) {
+        if (action == SEG_PENDING)
+            s->state = SB_LOOKAHEAD;
+        else if (action == SEG_BREAK || !(bit & (SB_BIT(CLOSE) | SB_BIT(SP))))
+            s->state = SB_TEXT;
+        else if (cls == UCDN_SENTENCE_BREAK_SP)
+            s->state = SB_SPACE;
+    }
+    if (s->state == SB_TEXT && (bit & SB_SATERM)) {
+        /* SB7 needs to know if an upper or lowercase letter came before */
+        s->wait = s->prev == UCDN_SENTENCE_BREAK_UPPER ||
+            s->prev == UCDN_SENTENCE_BREAK_LOWER;
+        s->term = cls;
+        s->state = SB_TERM;
+    }
+    s->prev = cls;
+    return action;
+}
+
+/* Advance past a codepoint at pos, store the decided boundaries in out. */
+static size_t seg_next(Segmenter *s, uint32_t code, size_t pos, size_t *out)
+{
+    int props = get_segment_props(code), resolved = SEG_NONE, action;
+    size_t n = 0;
+
+    if (s->type == UCDN_SEGMENT_WORD)
+        action = wb_next(s, props, &resolved);
+    else
+        action = sb_next(s, props, &resolved);
+
+    if (resolved == SEG_BREAK)
+        out[n++] = s->pending_pos;
+    if (action == SEG_BREAK) {
+        out[n++] = pos;
+    } else if (action == SEG_PENDING) {
+        s->pending = 1;
+        s->pending_pos = pos;
+    }
+    return n;
+}
+
+static size_t seg_put(Segmenter *s, const void *src, size_t len,
+                      size_t *boundaries)
+{
+    size_t i = 0, end, start, n = 0;
+    int partial_len = s->partial_len;
+    uint32_t code;
+
+    if (partial_len > 0) {
+        if (!stream_resume(s->encoding, s->partial, &s->partial_len, src,
+                           len, &i, &code)) {
+            s->offset += len;
+            return 0;
+        }
+        n += seg_next(s, code, s->offset - partial_len, boundaries + n);
+    }
+
+    end = len - stream_tail(s->encoding, src, len);
+    while (i < end) {
+        start = i;
+        code = read_code(s->encoding, src, end, &i);
+        n += seg_next(s, code, s->offset + start, boundaries + n);
+    }
+
+    /* keep an incomplete sequence at the end for the next chunk */
+    for (; i < len; i++)
+        s->partial[s->partial_len++] = code_unit(s->encoding, src, i);
+    s->offset += len;
+    return n;
+}
+
+int ucdn_segmenter_init(UCDNSegmenter *s, int type)
+{
+    if (type != UCDN_SEGMENT_WORD && type != UCDN_SEGMENT_SENTENCE)
+        return 0;
+
+    s->type = type;
+    s->encoding = ENCODING_UTF32;
+    s->last = SEG_SOT;
+    s->prev = SEG_SOT;
+    s->term = 0;
+    s->state = SB_TEXT;
+    s->ri = 0;
+    s->wait = 0;
+    s->pending = 0;
+    s->pending_pos = 0;
+    s->offset = 0;
+    s->partial_len = 0;
+    return 1;
+}
+
+size_t ucdn_segmenter_put(UCDNSegmenter *s, const uint32_t *src, size_t len,
+                          size_t *boundaries)
+{
+    s->encoding = ENCODING_UTF32;
+    return seg_put(s, src, len, boundaries);
+}
+
+size_t ucdn_segmenter_put_utf16(UCDNSegmenter *s, const uint16_t *src,
+                                size_t len, size_t *boundaries)
+{
+    s->encoding = ENCODING_UTF16;
+    return seg_put(s, src, len, boundaries);
+}
+
+size_t ucdn_segmenter_put_utf8(UCDNSegmenter *s, const uint8_t *src,
+                               size_t len, size_t *boundaries)
+{
+    s->encoding = ENCODING_UTF8;
+    return seg_put(s, src, len, boundaries);
+}
+
+size_t ucdn_segmenter_finish(UCDNSegmenter *s, size_t *boundaries)
+{
+    size_t n = 0;
+
+    /* an incomplete sequence at the end of the stream is ill-formed */
+    if (s->partial_len > 0) {
+        n += seg_next(s, 0xfffd, s->offset - s->partial_len, boundaries);
+        s->partial_len = 0;
+    }
+
+    /* the rules that look ahead do not match at the end of text */
+    if (s->pending)
+        boundaries[n++] = s->pending_pos;
+    if (s->offset > 0)
+        boundaries[n++] = s->offset;
+    ucdn_segmenter_init(s, s->type);
+    return n;
+}
+
+/*
+ * Bidirectional algorithm (UAX#9)
+ *
+ * The isolating run sequences are not collected. The scratch holds a
+ * link for every character: the matching PDI of an isolate initiator,
+ * the initiator of a matched PDI, and the closing bracket of a paired
+ * opening bracket. A sequence is walked by skipping the characters
+ * removed by X9 and by jumping from an initiator that ends a level run
+ * to its matching PDI. While isolates are matched, the open initiators
+ * are chained through their links as well, so no memory depends on the
+ * nesting depth. Without explicit formatting, the paragraph is a single
+ * sequence that is walked directly. Paragraphs without right-to-left or
+ * explicit formatting classes are all at level 0 and only take a bulk
+ * class lookup.
+ */
+
+#define BIDI_MAX_DEPTH 125
+#define BIDI_MAX_BRACKETS 63
+
+#define BIDI_BIT(cls) (1UL << UCDN_BIDI_CLASS_##cls)
+#define BIDI_IS(t, mask) ((1UL << (t)) & (mask))
+
+#define BIDI_REMOVED (BIDI_BIT(LRE) | BIDI_BIT(RLE) | BIDI_BIT(LRO) | \
+    BIDI_BIT(RLO) | BIDI_BIT(PDF) | BIDI_BIT(BN))
+#define BIDI_ISOLATES (BIDI_BIT(LRI) | BIDI_BIT(RLI) | BIDI_BIT(FSI))
+#define BIDI_NEUTRALS (BIDI_BIT(B) | BIDI_BIT(S) | BIDI_BIT(WS) | \
+    BIDI_BIT(ON) | BIDI_ISOLATES | BIDI_BIT(PDI))
+/* the classes that can give a level other than 0 in a LTR paragraph */
+#define BIDI_COMPLEX (BIDI_BIT(R) | BIDI_BIT(AL) | BIDI_BIT(AN) | \
+    (BIDI_REMOVED & ~BIDI_BIT(BN)) | BIDI_ISOLATES | BIDI_BIT(PDI))
+/* reset to the paragraph level before a separator or the end of a line */
+#define BIDI_TRAILING (BIDI_BIT(WS) | BIDI_ISOLATES | BIDI_BIT(PDI) | \
+    BIDI_REMOVED)
+
+typedef struct {
+    const uint32_t *src;
+    uint8_t *types;
+    uint8_t *levels;
+    size_t *links;
+    size_t len;
+    int level;
+    int flat; /* no explicit formatting, the paragraph is one sequence */
+} Bidi;
+
+typedef struct {
+    uint8_t level;
+    uint8_t override; /* class the characters are reset to, or ON */
+    uint8_t isolate;
+} BidiStatus;
+
+static int bidi_is_initiator(const Bidi *b, size_t i)
+{
+    return BIDI_IS(ucdn_get_bidi_class(b->src[i]), BIDI_ISOLATES) != 0;
+}
+
+/* unmatch the open initiators chained from top */
+static void bidi_unmatch(Bidi *b, size_t top)
+{
+    size_t up;
+
+    while (top != b->len) {
+        up = b->links[top];
+        b->links[top] = b->len;
+        top = up;
+    }
+}
+
+/* BD9, isolate initiators and PDIs are linked to each other */
+static void bidi_match_isolates(Bidi *b)
+{
+    size_t i, top = b->len, up;
+
+    for (i = 0; i < b->len; i++) {
+        int t = b->types[i];
+
+        if (BIDI_IS(t, BIDI_ISOLATES)) {
+            b->links[i] = top;
+            top = i;
+        } else if (t == UCDN_BIDI_CLASS_PDI && top != b->len) {
+            up = b->links[top];
+            b->links[top] = i;
+            b->links[i] = top;
+            top = up;
+        } else {
+            b->links[i] = b->len;
+            if (t == UCDN_BIDI_CLASS_B) {
+                bidi_unmatch(b, top);
+                top = b->len;
+            }
+        }
+    }
+    bidi_unmatch(b, top);
+}
+
+/*
+ * P2, P3: 1 if the first strong class in [start, end) outside of
+ * isolates is R or AL, 0 if it is L, -1 if there is none.
+ */
+static int bidi_first_strong(const Bidi *b, size_t start, size_t end)
+{
+    size_t i;
+
+    for (i = start; i < end; i++) {
+        int t = b->types[i];
+
+        if (t == UCDN_BIDI_CLASS_L)
+            return 0;
+        if (t == UCDN_BIDI_CLASS_R || t == UCDN_BIDI_CLASS_AL)
+            return 1;
+        if (t == UCDN_BIDI_CLASS_B)
+            break;
+        if (BIDI_IS(t, BIDI_ISOLATES)) {
+            if (b->links[i] == b->len)
+                break;
+            i = b->links[i];
+        }
+    }
+    return -1;
+}
+
+/* X1-X8, explicit levels and directional overrides */
+static void bidi_explicit(Bidi *b)
+{
+    BidiStatus stack[BIDI_MAX_DEPTH + 2];
+    size_t i, depth = 0;
+    int overflow_isolates = 0, overflow_embeddings = 0, valid_isolates = 0;
+
+    stack[0].level = (uint8_t)b->level;
+    stack[0].override = UCDN_BIDI_CLASS_ON;
+    stack[0].isolate = 0;
+
+    for (i = 0; i < b->len; i++) {
+        int t = b->types[i], level = stack[depth].level, next;
+
+        b->levels[i] = (uint8_t)level;
+        switch (t) {
+        case UCDN_BIDI_CLASS_LRE:
+        case UCDN_BIDI_CLASS_RLE:
+        case UCDN_BIDI_CLASS_LRO:
+        case UCDN_BIDI_CLASS_RLO:
+            if (t == UCDN_BIDI_CLASS_RLE || t == UCDN_BIDI_CLASS_RLO)
+                next = (level + 1) | 1;
+            else
+                next = (level + 2) & ~1;
+            if (next <= BIDI_MAX_DEPTH && !overflow_isolates &&
+                    !overflow_embeddings) {
+                depth++;
+                stack[depth].level = (uint8_t)next;
+                stack[depth].override = UCDN_BIDI_CLASS_ON;
+                if (t == UCDN_BIDI_CLASS_LRO)
+                    stack[depth].override = UCDN_BIDI_CLASS_L;
+                else if (t == UCDN_BIDI_CLASS_RLO)
+                    stack[depth].override = UCDN_BIDI_CLASS_R;
+                stack[depth].isolate = 0;
+            } else if (!overflow_isolates) {
+                overflow_embeddings++;
+            }
+            break;
+        case UCDN_BIDI_CLASS_LRI:
+        case UCDN_BIDI_CLASS_RLI:
+        case UCDN_BIDI_CLASS_FSI:
+            if (stack[depth].override != UCDN_BIDI_CLASS_ON)
+                b->types[i] = stack[depth].override;
+            if (t == UCDN_BIDI_CLASS_FSI)
+                t = bidi_first_strong(b, i + 1, b->links[i]) == 1 ?
+                    UCDN_BIDI_CLASS_RLI : UCDN_BIDI_CLASS_LRI;
+            next = t == UCDN_BIDI_CLASS_RLI ? (level + 1) | 1 :
+                (level + 2) & ~1;
+            if (next <= BIDI_MAX_DEPTH && !overflow_isolates &&
+                    !overflow_embeddings) {
+                valid_isolates++;
+                depth++;
+                stack[depth].level = (uint8_t)next;
+                stack[depth].override = UCDN_BIDI_CLASS_ON;
+                stack[depth].isolate = 1;
+            } else {
+                overflow_isolates++;
+            }
+            break;
+        case UCDN_BIDI_CLASS_PDI:
+            if (overflow_isolates) {
+                overflow_isolates--;
+            } else if (valid_isolates) {
+                overflow_embeddings = 0;
+                while (!stack[depth].isolate)
+                    depth--;
+                depth--;
+                valid_isolates--;
+            }
+            b->levels[i] = stack[depth].level;
+            if (stack[depth].override != UCDN_BIDI_CLASS_ON)
+                b->types[i] = stack[depth].override;
+            break;
+        case UCDN_BIDI_CLASS_PDF:
+            if (overflow_isolates)
+                ;
+            else if (overflow_embeddings)
+                overflow_embeddings--;
+            else if (!stack[depth].isolate && depth > 0)
+                depth--;
+            break;
+        case UCDN_BIDI_CLASS_B:
+            /* X8, a separator ends all embeddings */
+            b->levels[i] = (uint8_t)b->level;
+            depth = 0;
+            overflow_isolates = overflow_embeddings = valid_isolates = 0;
+            break;
+        case UCDN_BIDI_CLASS_BN:
+            break;
+        default:
+            if (stack[depth].override != UCDN_BIDI_CLASS_ON)
+                b->types[i] = stack[depth].override;
+            break;
+        }
+    }
+}
+
+/* the first character at or after i that is not removed by X9 */
+static size_t bidi_skip(const Bidi *b, size_t i)
+{
+    while (i < b->len && BIDI_IS(b->types[i], BIDI_REMOVED))
+        i++;
+    return i;
+}
+
+/* the character after i in its isolating run sequence, or len */
+static size_t bidi_next(const Bidi *b, size_t i)
+{
+    size_t j;
+
+    if (b->flat)
+        return i + 1;
+    j = bidi_skip(b, i + 1);
+    if (j < b->len && b->levels[j] == b->levels[i])
+        return j;
+    if (b->links[i] > i && b->links[i] < b->len && bidi_is_initiator(b, i))
+        return b->links[i];
+    return b->len;
+}
+
+static uint32_t bidi_canonical_bracket(uint32_t code)
+{
+    /* the angle brackets are canonically equivalent to CJK brackets */
+    if (code == 0x2329)
+        return 0x3008;
+    if (code == 0x232a)
+        return 0x3009;
+    return code;
+}
+
+/*
+ * BD16, link the opening brackets of the sequence to their pair.
+ * Returns the number of pairs.
+ */
+static size_t bidi_pair_brackets(Bidi *b, size_t start)
+{
+    struct {
+        size_t pos;
+        uint32_t close;
+    } open[BIDI_MAX_BRACKETS];
+    size_t i, n = 0, k, pairs = 0;
+    uint32_t pair;
+    int type;
+
+    for (i = start; i < b->len; i = bidi_next(b, i)) {
+        if (b->types[i] != UCDN_BIDI_CLASS_ON)
+            continue;
+        type = ucdn_get_bracket_pair(b->src[i], &pair);
+        if (type == UCDN_BIDI_PAIRED_BRACKET_TYPE_OPEN) {
+            if (n == BIDI_MAX_BRACKETS)
+                break;
+            open[n].pos = i;
+            open[n].close = bidi_canonical_bracket(pair);
+            n++;
+        } else if (type == UCDN_BIDI_PAIRED_BRACKET_TYPE_CLOSE) {
+            pair = bidi_canonical_bracket(b->src[i]);
+            for (k = n; k > 0; k--) {
+                if (open[k - 1].close == pair) {
+                    b->links[open[k - 1].pos] = i;
+                    n = k - 1;
+                    pairs++;
+                    break;
+                }
+            }
+        }
+    }
+    return pairs;
+}
+
+/* the marks that followed a bracket take its resolved class */
+static void bidi_bracket_marks(Bidi *b, size_t i, int t)
+{
+    for (i = bidi_next(b, i); i < b->len &&
+            ucdn_get_bidi_class(b->src[i]) == UCDN_BIDI_CLASS_NSM;
+            i = bidi_next(b, i))
+        b->types[i] = (uint8_t)t;
+}
+
+/*
+ * N0 for the pair opened at open, given the strong class before it and
+ * the embedding direction. Returns the resolved class of the brackets.
+ */
+static int bidi_resolve_pair(Bidi *b, size_t open, int before, int e)
+{
+    size_t close = b->links[open], i;
+    int found = UCDN_BIDI_CLASS_ON, t;
+
+    for (i = bidi_next(b, open); i != close; i = bidi_next(b, i)) {
+        t = b->types[i];
+        if (t == UCDN_BIDI_CLASS_EN || t == UCDN_BIDI_CLASS_AN)
+            t = UCDN_BIDI_CLASS_R;
+        if (t == e) {
+            found = e;
+            break;
+        }
+        if (t == UCDN_BIDI_CLASS_L || t == UCDN_BIDI_CLASS_R)
+            found = t;
+    }
+    if (found == UCDN_BIDI_CLASS_ON)
+        return found;
+    if (found != e && before != found)
+        found = e;
+
+    b->types[open] = b->types[close] = (uint8_t)found;
+    bidi_bracket_marks(b, open, found);
+    bidi_bracket_marks(b, close, found);
+    return found;
+}
+
+/* set the class of the characters from start up to end */
+static void bidi_fill(Bidi *b, size_t start, size_t end, int t)
+{
+    size_t i;
+
+    for (i = start; i != end; i = bidi_next(b, i))
+        b->types[i] = (uint8_t)t;
+}
+
+/* W4, single separators between numbers */
+static void bidi_separators(Bidi *b, size_t start, int sos)
+{
+    size_t i, next;
+    int t, prev = sos;
+
+    for (i = start; i < b->len; i = next) {
+        next = bidi_next(b, i);
+        t = b->types[i];
+        if ((t == UCDN_BIDI_CLASS_ES || t == UCDN_BIDI_CLASS_CS) &&
+                next < b->len) {
+            if (prev == UCDN_BIDI_CLASS_EN &&
+                    b->types[next] == UCDN_BIDI_CLASS_EN)
+                b->types[i] = UCDN_BIDI_CLASS_EN;
+            else if (t == UCDN_BIDI_CLASS_CS && prev == UCDN_BIDI_CLASS_AN &&
+                     b->types[next] == UCDN_BIDI_CLASS_AN)
+                b->types[i] = UCDN_BIDI_CLASS_AN;
+        }
+        prev = b->types[i];
+    }
+}
+
+/* W5, terminators next to European numbers */
+static void bidi_terminators(Bidi *b, size_t start, int sos)
+{
+    size_t i, run = b->len;
+    int t, prev = sos;
+
+    for (i = start; i < b->len; i = bidi_next(b, i)) {
+        t = b->types[i];
+        if (t == UCDN_BIDI_CLASS_ET) {
+            if (prev == UCDN_BIDI_CLASS_EN)
+                b->types[i] = UCDN_BIDI_CLASS_EN;
+            else if (run == b->len)
+                run = i;
+        } else {
+            if (t == UCDN_BIDI_CLASS_EN && run != b->len)
+                bidi_fill(b, run, i, UCDN_BIDI_CLASS_EN);
+            run = b->len;
+        }
+        prev = b->types[i];
+    }
+}
+
+/* W6, W7 */
+static void bidi_weak_types(Bidi *b, size_t start, int sos)
+{
+    size_t i;
+    int t, strong = sos;
+
+    /* without branches on the class, which change at random in mixed text */
+    for (i = start; i < b->len; i = bidi_next(b, i)) {
+        t = b->types[i];
+        t = BIDI_IS(t, BIDI_BIT(ES) | BIDI_BIT(ET) | BIDI_BIT(CS)) ?
+            UCDN_BIDI_CLASS_ON : t;
+        t = t == UCDN_BIDI_CLASS_EN && strong == UCDN_BIDI_CLASS_L ?
+            UCDN_BIDI_CLASS_L : t;
+        strong = t == UCDN_BIDI_CLASS_L || t == UCDN_BIDI_CLASS_R ?
+            t : strong;
+        b->types[i] = (uint8_t)t;
+    }
+}
+
+/* N0, in the order of the opening brackets */
+static void bidi_brackets(Bidi *b, size_t start, int sos, int e)
+{
+    size_t i;
+    int t, strong = sos;
+
+    if (!bidi_pair_brackets(b, start))
+        return;
+
+    for (i = start; i < b->len; i = bidi_next(b, i)) {
+        t = b->types[i];
+        if (t == UCDN_BIDI_CLASS_ON && b->links[i] != b->len)
+            t = bidi_resolve_pair(b, i, strong, e);
+        if (t == UCDN_BIDI_CLASS_L)
+            strong = t;
+        else if (t == UCDN_BIDI_CLASS_R || t == UCDN_BIDI_CLASS_EN ||
+                 t == UCDN_BIDI_CLASS_AN)
+            strong = UCDN_BIDI_CLASS_R;
+    }
+}
+
+/* N1, N2 */
+static void bidi_neutrals(Bidi *b, size_t start, int sos, int eos, int e)
+{
+    size_t i, run = b->len;
+    int t, strong = sos;
+
+    for (i = start; i < b->len; i = bidi_next(b, i)) {
+        t = b->types[i];
+        if (BIDI_IS(t, BIDI_NEUTRALS)) {
+            if (run == b->len)
+                run = i;
+            continue;
+        }
+        if (t != UCDN_BIDI_CLASS_L)
+            t = UCDN_BIDI_CLASS_R;
+        if (run != b->len)
+            bidi_fill(b, run, i, strong == t ? t : e);
+        run = b->len;
+        strong = t;
+    }
+    if (run != b->len)
+        bidi_fill(b, run, b->len, strong == eos ? eos : e);
+}
+
+/*
+ * W1-W7 and N0-N2 for the isolating run sequence starting at start,
+ * given the level of the character before it. W1-W3 are applied in one
+ * pass, which also finds the classes that the other rules need.
+ */
+static void bidi_resolve_sequence(Bidi *b, size_t start, int before)
+{
+    size_t i, next, last = start, len = b->len;
+    int level = b->levels[start], after, sos, eos, e, t, prev, strong;
+    unsigned long seen = 0;
+
+    e = level & 1 ? UCDN_BIDI_CLASS_R : UCDN_BIDI_CLASS_L;
+    sos = (level > before ? level : before) & 1 ?
+        UCDN_BIDI_CLASS_R : UCDN_BIDI_CLASS_L;
+
+    /* W1-W3 */
+    prev = strong = sos;
+    for (i = start; i < len; i = bidi_next(b, i)) {
+        t = b->types[i];
+        if (t == UCDN_BIDI_CLASS_NSM)
+            t = BIDI_IS(prev, BIDI_ISOLATES | BIDI_BIT(PDI)) ?
+                UCDN_BIDI_CLASS_ON : prev;
+        prev = t;
+        t = t == UCDN_BIDI_CLASS_EN && strong == UCDN_BIDI_CLASS_AL ?
+            UCDN_BIDI_CLASS_AN : t;
+        strong = BIDI_IS(t, BIDI_BIT(L) | BIDI_BIT(R) | BIDI_BIT(AL)) ?
+            t : strong;
+        t = t == UCDN_BIDI_CLASS_AL ? UCDN_BIDI_CLASS_R : t;
+        b->types[i] = (uint8_t)t;
+        seen |= 1UL << t;
+        last = i;
+    }
+
+    /* X10, the level after the sequence */
+    next = bidi_skip(b, last + 1);
+    if (next == len || bidi_is_initiator(b, last))
+        after = b->level;
+    else
+        after = b->levels[next];
+    eos = (level > after ? level : after) & 1 ?
+        UCDN_BIDI_CLASS_R : UCDN_BIDI_CLASS_L;
+
+    if ((seen & (BIDI_BIT(ES) | BIDI_BIT(CS))) &&
+            (seen & (BIDI_BIT(EN) | BIDI_BIT(AN))))
+        bidi_separators(b, start, sos);
+    if ((seen & BIDI_BIT(ET)) && (seen & BIDI_BIT(EN)))
+        bidi_terminators(b, start, sos);
+    if (seen & (BIDI_BIT(ES) | BIDI_BIT(ET) | BIDI_BIT(CS) | BIDI_BIT(EN)))
+        bidi_weak_types(b, start, sos);
+    if (seen & BIDI_BIT(ON))
+        bidi_brackets(b, start, sos, e);
+    /* W6 makes the remaining separators and terminators neutral */
+    if (seen & (BIDI_NEUTRALS | BIDI_BIT(ES) | BIDI_BIT(ET) | BIDI_BIT(CS)))
+        bidi_neutrals(b, start, sos, eos, e);
+}
+
+/* I1, I2; removed characters take the level of the one before */
+static void bidi_implicit(Bidi *b)
+{
+    size_t i;
+
+    for (i = 0; i < b->len; i++) {
+        int t = b->types[i], level = b->levels[i];
+
+        if (BIDI_IS(t, BIDI_REMOVED))
+            level = i > 0 ? b->levels[i - 1] : b->level;
+        else if (level & 1)
+            level += t == UCDN_BIDI_CLASS_L || t == UCDN_BIDI_CLASS_EN ||
+                t == UCDN_BIDI_CLASS_AN;
+        else if (t == UCDN_BIDI_CLASS_R)
+            level += 1;
+        else if (t == UCDN_BIDI_CLASS_EN || t == UCDN_BIDI_CLASS_AN)
+            level += 2;
+        b->levels[i] = (uint8_t)level;
+    }
+}
+
+/* L1, given the original classes */
+static void bidi_reset_whitespace(const uint8_t *classes, uint8_t *levels,
+                                  size_t len, int level)
+{
+    int trailing = 1;
+
+    while (len-- > 0) {
+        int t = classes[len];
+
+        if (t == UCDN_BIDI_CLASS_S || t == UCDN_BIDI_CLASS_B) {
+            levels[len] = (uint8_t)level;
+            trailing = 1;
+        } else if (trailing && BIDI_IS(t, BIDI_TRAILING)) {
+            levels[len] = (uint8_t)level;
+        } else {
+            trailing = 0;
+        }
+    }
+}
+
+int ucdn_bidi_resolve(int direction, const uint32_t *src, size_t len,
+                      uint8_t *levels, size_t *scratch)
+{
+    Bidi b;
+    unsigned long seen = 0;
+    size_t i, prev;
+
+    if (direction != UCDN_BIDI_DIRECTION_LTR &&
+            direction != UCDN_BIDI_DIRECTION_RTL &&
+            direction != UCDN_BIDI_DIRECTION_AUTO)
+        return -1;
+
+    b.src = src;
+    b.len = len;
+    b.levels = levels;
+    b.links = scratch;
+    b.types = (uint8_t *)(scratch + len);
+    get_bidi_classes(src, b.types, len);
+
+    for (i = 0; i < len; i++)
+        seen |= 1UL << b.types[i];
+    if (!(seen & BIDI_COMPLEX) && direction != UCDN_BIDI_DIRECTION_RTL) {
+        memset(levels, 0, len);
+        return 0;
+    }
+
+    b.flat = !(seen & (BIDI_REMOVED | BIDI_ISOLATES | BIDI_BIT(PDI)));
+    bidi_match_isolates(&b);
+    if (direction == UCDN_BIDI_DIRECTION_AUTO)
+        b.level = bidi_first_strong(&b, 0, len) == 1;
+    else
+        b.level = direction;
+    bidi_explicit(&b);
+
+    /* each sequence starts a level run, but not with a matched PDI */
+    prev = len;
+    for (i = bidi_skip(&b, 0); i < len; i = bidi_skip(&b, i + 1)) {
+        if ((prev == len || levels[prev] != levels[i]) && b.links[i] >= i)
+            bidi_resolve_sequence(&b, i, prev == len ? b.level : levels[prev]);
+        prev = i;
+    }
+    bidi_implicit(&b);
+
+    get_bidi_classes(src, b.types, len);
+    bidi_reset_whitespace(b.types, levels, len, b.level);
+    return b.level;
+}
+
+void ucdn_bidi_line_levels(const uint32_t *line, uint8_t *levels, size_t len,
+                           int paragraph_level)
+{
+    while (len-- > 0 && BIDI_IS(ucdn_get_bidi_class(line[len]),
+                                BIDI_TRAILING | BIDI_BIT(S) | BIDI_BIT(B)))
+        levels[len] = (uint8_t)paragraph_level;
+}
+
+void ucdn_bidi_reorder(const uint8_t *levels, size_t len, size_t *order)
+{
+    size_t i, j, k;
+    int level, highest = 0, lowest_odd = BIDI_MAX_DEPTH + 2;
+
+    for (i = 0; i < len; i++) {
+        order[i] = i;
+        if (levels[i] > highest)
+            highest = levels[i];
+        if ((levels[i] & 1) && levels[i] < lowest_odd)
+            lowest_odd = levels[i];
+    }
+
+    /* L2, reverse the runs at each level, from the highest down */
+    for (level = highest; level >= lowest_odd; level--) {
+        for (i = 0; i < len; i = j + 1) {
+            for (j = i; j < len && levels[order[j]] >= level; j++)
+                ;
+            for (k = j; k > i + 1; i++, k--) {
+                size_t tmp = order[i];
+                order[i] = order[k - 1];
+                order[k - 1] = tmp;
+            }
+        }
+    }
+}
@@ -22,6 +22,7 @@ extern "C" {
 #endif
 
 #include <stdint.h>
+#include <stddef.h>
 
 #define UCDN_EAST_ASIAN_F 0
 #define UCDN_EAST_ASIAN_H 1
@@ -287,6 +288,19 @@ extern "C" {
 #define UCDN_BIDI_PAIRED_BRACKET_TYPE_CLOSE 1
 #define UCDN_BIDI_PAIRED_BRACKET_TYPE_NONE 2
 
+/**
+ * All properties of a codepoint that are stored in the main database
+ * record, as returned by ucdn_get_properties().
+ */
+typedef struct {
+    uint8_t category;
+    uint8_t combining;
+    uint8_t bidi_class;
+    uint8_t east_asian_width;
+    uint8_t script;
+    uint8_t linebreak_class;
+} UCDNProperties;
+
 /**
  * Return version of the Unicode database.
  *
@@ -294,6 +308,24 @@ extern "C" {
  */
 const char *ucdn_get_unicode_version(void);
 
+#define UCDN_LAYOUT_FLAT_BMP 1
+#define UCDN_LAYOUT_PACKED_RECORDS 2
+#define UCDN_LAYOUT_PROPERTY_TRIES 4
+#define UCDN_LAYOUT_UTF32_DECOMP 8
+
+/**
+ * Return the database table layout UCDN was built with.
+ *
+ * The layout is selected at build time with the UCDN_FLAT_BMP,
+ * UCDN_PACKED_RECORDS, UCDN_PROPERTY_TRIES and UCDN_UTF32_DECOMP
+ * macros, which set the UCDN_LAYOUT_FLAT_BMP, UCDN_LAYOUT_PACKED_RECORDS,
+ * UCDN_LAYOUT_PROPERTY_TRIES and UCDN_LAYOUT_UTF32_DECOMP bits. The
+ * default compact layout has none of these.
+ *
+ * @return bitmask of UCDN_LAYOUT_* flags
+ */
+int ucdn_get_table_layout(void);
+
 /**
  * Get combining class of a codepoint.
  *
@@ -356,6 +388,17 @@ int ucdn_get_linebreak_class(uint32_t code);
  */
 int ucdn_get_resolved_linebreak_class(uint32_t code);
 
+/**
+ * Get all database properties of an array of codepoints at once. This
+ * is the fastest way to query several properties per codepoint.
+ *
+ * @param code array of Unicode codepoints
+ * @param props filled with properties of each codepoint
+ * @param len number of codepoints
+ */
+void ucdn_get_properties(const uint32_t *code, UCDNProperties *props,
+                         size_t len);
+
 /**
  * Check if codepoint can be mirrored.
  *
@@ -392,6 +435,20 @@ uint32_t ucdn_paired_bracket(uint32_t code);
  */
 int ucdn_paired_bracket_type(uint32_t code);
 
+/**
+ * Get paired bracket and paired bracket type for a codepoint.
+ *
+ * This is equivalent to calling ucdn_paired_bracket() and
+ * ucdn_paired_bracket_type(), but needs only a single lookup.
+ *
+ * @param code Unicode codepoint
+ * @param pair pointer to paired bracket codepoint, set to the original
+ * codepoint if no paired bracket character exists
+ * @return value according to UCDN_BIDI_PAIRED_BRACKET_TYPE_* and as defined
+ * in UAX#9.
+ */
+int ucdn_get_bracket_pair(uint32_t code, uint32_t *pair);
+
 /**
  * Pairwise canonical decomposition of a codepoint. This includes
  * Hangul Jamo decomposition (see chapter 3.12 of the Unicode core
@@ -407,6 +464,36 @@ int ucdn_paired_bracket_type(uint32_t code);
  */
 int ucdn_decompose(uint32_t code, uint32_t *a, uint32_t *b);
 
+/**
+ * Full canonical decomposition of a codepoint. Unlike ucdn_decompose(),
+ * the decomposition is expanded recursively, so the result is the NFD
+ * form of the codepoint (before canonical reordering with neighbouring
+ * characters). This includes Hangul syllables.
+ *
+ * @param code Unicode codepoint
+ * @param decomposed filled with decomposition, must be able to hold 4
+ * characters
+ * @return length of decomposition or 0 in case none exists
+ */
+int ucdn_canonical_decompose_full(uint32_t code, uint32_t *decomposed);
+
+/**
+ * Canonical reordering of a decomposed string. Every run of
+ * non-starters is sorted by combining class, keeping the order of
+ * marks with the same class. The combining classes are looked up in
+ * bulk and each run is sorted in linear time, so even a long run of
+ * marks after one starter is cheap. Source and destination must not
+ * overlap.
+ *
+ * @param src decomposed string
+ * @param len length of src in codepoints
+ * @param dst filled with the reordered string, must hold len codepoints
+ * @param ccc filled with the combining classes of dst, must hold len
+ * values
+ */
+void ucdn_canonical_reorder(const uint32_t *src, size_t len, uint32_t *dst,
+                            uint8_t *ccc);
+
 /**
  * Compatibility decomposition of a codepoint.
  *
@@ -433,6 +520,951 @@ int ucdn_compat_decompose(uint32_t code, uint32_t *decomposed);
  */
 int ucdn_compose(uint32_t *code, uint32_t a, uint32_t b);
 
+#define UCDN_NORMALIZATION_NFD 0
+#define UCDN_NORMALIZATION_NFC 1
+#define UCDN_NORMALIZATION_NFKD 2
+#define UCDN_NORMALIZATION_NFKC 3
+/* flag for the forms above, see ucdn_stream_safe() */
+#define UCDN_NORMALIZATION_STREAM_SAFE 4
+
+#define UCDN_NORMALIZE_ERROR ((size_t)-1)
+
+#define UCDN_NORMALIZER_SEGMENT_MAX 256
+#define UCDN_NORMALIZER_PENDING_MAX (UCDN_NORMALIZER_SEGMENT_MAX + 18)
+
+/**
+ * State of a normalizer, for normalizing a stream of text in chunks.
+ * The members are private, use the ucdn_normalizer_* functions. The
+ * size is fixed, so the state can live on the stack or inside another
+ * structure.
+ */
+typedef struct {
+    int form;
+    int compose;
+    int compat;
+    int qc_shift;
+    int stream;
+    int error;
+    int overflow;
+    int encoding;
+    int stream_safe;
+    int nonstarters;
+    int len;
+    uint32_t code[UCDN_NORMALIZER_SEGMENT_MAX];
+    uint8_t ccc[UCDN_NORMALIZER_SEGMENT_MAX];
+    void *dst;
+    size_t dst_len;
+    size_t out;
+    size_t pos;
+    size_t starter_pos;
+    uint32_t pending[UCDN_NORMALIZER_PENDING_MAX];
+    int pending_len;
+    int pending_pos;
+    uint32_t partial[3];
+    int partial_len;
+} UCDNNormalizer;
+
+#define UCDN_QUICK_CHECK_YES 0
+#define UCDN_QUICK_CHECK_MAYBE 1
+#define UCDN_QUICK_CHECK_NO 2
+
+/**
+ * Normalize a UTF-32 string.
+ *
+ * The output is written to a caller-supplied buffer and no memory is
+ * allocated. If the buffer is too small, the output is truncated
+ * after the last codepoint that fits, and the full length is still
+ * returned, so the call can be repeated with a large enough buffer.
+ * Source and destination must not overlap.
+ *
+ * Segments of a starter and the non-starters following it are
+ * processed in a fixed size buffer. A run of more than 255 non-starters
+ * (not Stream-Safe Text Format) does not fit, so it is read from src
+ * again for each combining class in it, which is slower but gives the
+ * same result. If the form includes UCDN_NORMALIZATION_STREAM_SAFE, the
+ * input is converted to Stream-Safe Text Format first, as with
+ * ucdn_stream_safe(), which bounds the segment length and the work per
+ * codepoint.
+ *
+ * @param form normalization form according to UCDN_NORMALIZATION_*
+ * @param src string to normalize
+ * @param len length of src in codepoints
+ * @param dst filled with the normalized string
+ * @param dst_len size of dst in codepoints
+ * @return length of the normalized string in codepoints, or
+ * UCDN_NORMALIZE_ERROR if the form is invalid
+ */
+size_t ucdn_normalize(int form, const uint32_t *src, size_t len,
+                      uint32_t *dst, size_t dst_len);
+
+/**
+ * Normalize a UTF-16 string. Works like ucdn_normalize(), lengths are
+ * in code units. Unpaired surrogates are replaced with U+FFFD.
+ *
+ * @param form normalization form according to UCDN_NORMALIZATION_*
+ * @param src string to normalize
+ * @param len length of src in code units
+ * @param dst filled with the normalized string
+ * @param dst_len size of dst in code units
+ * @return length of the normalized string in code units, or
+ * UCDN_NORMALIZE_ERROR if the form is invalid
+ */
+size_t ucdn_normalize_utf16(int form, const uint16_t *src, size_t len,
+                            uint16_t *dst, size_t dst_len);
+
+/**
+ * Normalize a UTF-8 string. Works like ucdn_normalize(), lengths are
+ * in bytes. Ill-formed sequences are replaced with U+FFFD.
+ *
+ * @param form normalization form according to UCDN_NORMALIZATION_*
+ * @param src string to normalize
+ * @param len length of src in bytes
+ * @param dst filled with the normalized string
+ * @param dst_len size of dst in bytes
+ * @return length of the normalized string in bytes, or
+ * UCDN_NORMALIZE_ERROR if the form is invalid
+ */
+size_t ucdn_normalize_utf8(int form, const uint8_t *src, size_t len,
+                           uint8_t *dst, size_t dst_len);
+
+/**
+ * Get the normalization quick check property (NFD_QC, NFC_QC, NFKD_QC or
+ * NFKC_QC) of a codepoint.
+ *
+ * @param code Unicode codepoint
+ * @param form normalization form according to UCDN_NORMALIZATION_*
+ * @return value according to UCDN_QUICK_CHECK_*, or -1 if the form is
+ * invalid
+ */
+int ucdn_get_quick_check(uint32_t code, int form);
+
+/**
+ * Find the longest prefix of a UTF-32 string that is known to be
+ * normalized. Normalizing the rest of the string and appending it to
+ * the prefix gives the normalized string, so already normalized text
+ * can be passed through without running the normalizer. The scan uses
+ * the quick check properties and may stop early, it never returns a
+ * prefix that could be changed by normalization. With
+ * UCDN_NORMALIZATION_STREAM_SAFE, the prefix is also in Stream-Safe Text
+ * Format.
+ *
+ * @param form normalization form according to UCDN_NORMALIZATION_*
+ * @param src string to check
+ * @param len length of src in codepoints
+ * @return length of the normalized prefix in codepoints, len if the
+ * whole string is normalized, 0 if the form is invalid
+ */
+size_t ucdn_normalized_prefix(int form, const uint32_t *src, size_t len);
+
+/**
+ * Find the longest prefix of a UTF-16 string that is known to be
+ * normalized. Works like ucdn_normalized_prefix(), lengths are in code
+ * units. The scan stops at unpaired surrogates.
+ *
+ * @param form normalization form according to UCDN_NORMALIZATION_*
+ * @param src string to check
+ * @param len length of src in code units
+ * @return length of the normalized prefix in code units
+ */
+size_t ucdn_normalized_prefix_utf16(int form, const uint16_t *src,
+                                    size_t len);
+
+/**
+ * Find the longest prefix of a UTF-8 string that is known to be
+ * normalized. Works like ucdn_normalized_prefix(), lengths are in
+ * bytes. The scan stops at ill-formed sequences.
+ *
+ * @param form normalization form according to UCDN_NORMALIZATION_*
+ * @param src string to check
+ * @param len length of src in bytes
+ * @return length of the normalized prefix in bytes
+ */
+size_t ucdn_normalized_prefix_utf8(int form, const uint8_t *src, size_t len);
+
+/**
+ * Initialize a normalizer for a stream of text.
+ *
+ * The input is passed in chunks of any size with ucdn_normalizer_put(),
+ * combining sequences may straddle chunk boundaries. Only the segment
+ * of the last starter is held back, normalized output is written as
+ * soon as the following input cannot change it anymore. At the end of
+ * the stream, ucdn_normalizer_finish() writes out the rest. No memory
+ * is allocated. All calls for a stream must use the same encoding.
+ *
+ * @param n normalizer to initialize
+ * @param form normalization form according to UCDN_NORMALIZATION_*
+ * @return 1 on success, 0 if the form is invalid
+ */
+int ucdn_normalizer_init(UCDNNormalizer *n, int form);
+
+/**
+ * Normalize a chunk of a UTF-32 stream.
+ *
+ * Input is consumed while the output fits into dst. Output that is
+ * produced but does not fit is held in the normalizer, and no more input
+ * is consumed until it has been written by a later call, so call again
+ * with the rest of the input until all of it is consumed. dst must be
+ * able to hold at least one encoded codepoint.
+ *
+ * The input is not kept, so unlike with ucdn_normalize(), more than
+ * 255 non-starters in a row are rejected, unless the normalizer was
+ * initialized with UCDN_NORMALIZATION_STREAM_SAFE. After an error, the
+ * normalizer must be initialized again.
+ *
+ * @param n normalizer
+ * @param src chunk of the stream
+ * @param len length of src in codepoints
+ * @param consumed set to the number of codepoints of src consumed
+ * @param dst filled with normalized output
+ * @param dst_len size of dst in codepoints
+ * @return number of codepoints written to dst, or UCDN_NORMALIZE_ERROR
+ */
+size_t ucdn_normalizer_put(UCDNNormalizer *n, const uint32_t *src,
+                           size_t len, size_t *consumed,
+                           uint32_t *dst, size_t dst_len);
+
+/**
+ * Normalize a chunk of a UTF-16 stream. Works like
+ * ucdn_normalizer_put(), lengths are in code units. A surrogate pair
+ * may be split between chunks.
+ *
+ * @param n normalizer
+ * @param src chunk of the stream
+ * @param len length of src in code units
+ * @param consumed set to the number of code units of src consumed
+ * @param dst filled with normalized output
+ * @param dst_len size of dst in code units
+ * @return number of code units written to dst, or UCDN_NORMALIZE_ERROR
+ */
+size_t ucdn_normalizer_put_utf16(UCDNNormalizer *n, const uint16_t *src,
+                                 size_t len, size_t *consumed,
+                                 uint16_t *dst, size_t dst_len);
+
+/**
+ * Normalize a chunk of a UTF-8 stream. Works like ucdn_normalizer_put(),
+ * lengths are in bytes. A multi-byte sequence may be split between
+ * chunks.
+ *
+ * @param n normalizer
+ * @param src chunk of the stream
+ * @param len length of src in bytes
+ * @param consumed set to the number of bytes of src consumed
+ * @param dst filled with normalized output
+ * @param dst_len size of dst in bytes
+ * @return number of bytes written to dst, or UCDN_NORMALIZE_ERROR
+ */
+size_t ucdn_normalizer_put_utf8(UCDNNormalizer *n, const uint8_t *src,
+                                size_t len, size_t *consumed,
+                                uint8_t *dst, size_t dst_len);
+
+/**
+ * End a UTF-32 stream and write the remaining output. Call repeatedly
+ * until it returns 0, the normalizer can then be used for a new stream.
+ *
+ * @param n normalizer
+ * @param dst filled with normalized output
+ * @param dst_len size of dst in codepoints
+ * @return number of codepoints written to dst, or UCDN_NORMALIZE_ERROR
+ */
+size_t ucdn_normalizer_finish(UCDNNormalizer *n, uint32_t *dst,
+                              size_t dst_len);
+
+/**
+ * End a UTF-16 stream, see ucdn_normalizer_finish(). An unpaired high
+ * surrogate at the end of the stream is replaced with U+FFFD.
+ *
+ * @param n normalizer
+ * @param dst filled with normalized output
+ * @param dst_len size of dst in code units
+ * @return number of code units written to dst, or UCDN_NORMALIZE_ERROR
+ */
+size_t ucdn_normalizer_finish_utf16(UCDNNormalizer *n, uint16_t *dst,
+                                    size_t dst_len);
+
+/**
+ * End a UTF-8 stream, see ucdn_normalizer_finish(). An incomplete
+ * sequence at the end of the stream is replaced with U+FFFD.
+ *
+ * @param n normalizer
+ * @param dst filled with normalized output
+ * @param dst_len size of dst in bytes
+ * @return number of bytes written to dst, or UCDN_NORMALIZE_ERROR
+ */
+size_t ucdn_normalizer_finish_utf8(UCDNNormalizer *n, uint8_t *dst,
+                                   size_t dst_len);
+
+/**
+ * Convert a UTF-32 string to Stream-Safe Text Format (UAX #15, section
+ * 13). A combining grapheme joiner (U+034F) is inserted wherever more
+ * than 30 non-starters would follow each other, counted in the NFKD
+ * form of the string. Text in this format has no combining sequence
+ * long enough to make normalization or rendering expensive. Output
+ * is written like with ucdn_normalize().
+ *
+ * @param src string to convert
+ * @param len length of src in codepoints
+ * @param dst filled with the converted string
+ * @param dst_len size of dst in codepoints
+ * @return length of the converted string in codepoints
+ */
+size_t ucdn_stream_safe(const uint32_t *src, size_t len,
+                        uint32_t *dst, size_t dst_len);
+
+/**
+ * Convert a UTF-16 string to Stream-Safe Text Format. Works like
+ * ucdn_stream_safe(), lengths are in code units. Unpaired surrogates
+ * are replaced with U+FFFD.
+ *
+ * @param src string to convert
+ * @param len length of src in code units
+ * @param dst filled with the converted string
+ * @param dst_len size of dst in code units
+ * @return length of the converted string in code units
+ */
+size_t ucdn_stream_safe_utf16(const uint16_t *src, size_t len,
+                              uint16_t *dst, size_t dst_len);
+
+/**
+ * Convert a UTF-8 string to Stream-Safe Text Format. Works like
+ * ucdn_stream_safe(), lengths are in bytes. Ill-formed sequences are
+ * replaced with U+FFFD.
+ *
+ * @param src string to convert
+ * @param len length of src in bytes
+ * @param dst filled with the converted string
+ * @param dst_len size of dst in bytes
+ * @return length of the converted string in bytes
+ */
+size_t ucdn_stream_safe_utf8(const uint8_t *src, size_t len,
+                             uint8_t *dst, size_t dst_len);
+
+/**
+ * Get the simple lowercase mapping of a codepoint.
+ *
+ * @param code Unicode codepoint
+ * @return lowercase codepoint, or code if it has no lowercase mapping
+ */
+uint32_t ucdn_to_lower(uint32_t code);
+
+/**
+ * Get the simple uppercase mapping of a codepoint.
+ *
+ * @param code Unicode codepoint
+ * @return uppercase codepoint, or code if it has no uppercase mapping
+ */
+uint32_t ucdn_to_upper(uint32_t code);
+
+/**
+ * Get the simple titlecase mapping of a codepoint.
+ *
+ * @param code Unicode codepoint
+ * @return titlecase codepoint, or code if it has no titlecase mapping
+ */
+uint32_t ucdn_to_title(uint32_t code);
+
+/**
+ * Full lowercase mapping of a codepoint. Unlike ucdn_to_lower(), this
+ * includes the mappings to more than one codepoint of SpecialCasing.txt.
+ * Language-specific and context-dependent mappings are not applied.
+ *
+ * @param code Unicode codepoint
+ * @param mapped filled with the mapping, must be able to hold 3
+ * characters
+ * @return length of the mapping
+ */
+int ucdn_to_lower_full(uint32_t code, uint32_t *mapped);
+
+/**
+ * Full uppercase mapping of a codepoint, e.g. U+00DF to "SS". Works
+ * like ucdn_to_lower_full().
+ *
+ * @param code Unicode codepoint
+ * @param mapped filled with the mapping, must be able to hold 3
+ * characters
+ * @return length of the mapping
+ */
+int ucdn_to_upper_full(uint32_t code, uint32_t *mapped);
+
+/**
+ * Full titlecase mapping of a codepoint, e.g. U+FB01 to "Fi". Works
+ * like ucdn_to_lower_full().
+ *
+ * @param code Unicode codepoint
+ * @param mapped filled with the mapping, must be able to hold 3
+ * characters
+ * @return length of the mapping
+ */
+int ucdn_to_title_full(uint32_t code, uint32_t *mapped);
+
+/**
+ * Convert a UTF-32 string to lowercase with the full case mappings.
+ * Capital sigma is mapped to final sigma at the end of a word. Output is
+ * written like with ucdn_normalize(), runs of ASCII are converted
+ * without table lookups.
+ *
+ * @param src string to convert
+ * @param len length of src in codepoints
+ * @param dst filled with the converted string
+ * @param dst_len size of dst in codepoints
+ * @return length of the converted string in codepoints
+ */
+size_t ucdn_lowercase(const uint32_t *src, size_t len,
+                      uint32_t *dst, size_t dst_len);
+
+/**
+ * Convert a UTF-16 string to lowercase. Works like ucdn_lowercase(),
+ * lengths are in code units. Unpaired surrogates are replaced with
+ * U+FFFD.
+ *
+ * @param src string to convert
+ * @param len length of src in code units
+ * @param dst filled with the converted string
+ * @param dst_len size of dst in code units
+ * @return length of the converted string in code units
+ */
+size_t ucdn_lowercase_utf16(const uint16_t *src, size_t len,
+                            uint16_t *dst, size_t dst_len);
+
+/**
+ * Convert a UTF-8 string to lowercase. Works like ucdn_lowercase(),
+ * lengths are in bytes. Ill-formed sequences are replaced with U+FFFD.
+ *
+ * @param src string to convert
+ * @param len length of src in bytes
+ * @param dst filled with the converted string
+ * @param dst_len size of dst in bytes
+ * @return length of the converted string in bytes
+ */
+size_t ucdn_lowercase_utf8(const uint8_t *src, size_t len,
+                           uint8_t *dst, size_t dst_len);
+
+/**
+ * Convert a UTF-32 string to uppercase with the full case mappings.
+ * Works like ucdn_lowercase().
+ *
+ * @param src string to convert
+ * @param len length of src in codepoints
+ * @param dst filled with the converted string
+ * @param dst_len size of dst in codepoints
+ * @return length of the converted string in codepoints
+ */
+size_t ucdn_uppercase(const uint32_t *src, size_t len,
+                      uint32_t *dst, size_t dst_len);
+
+/**
+ * Convert a UTF-16 string to uppercase. Works like ucdn_uppercase(),
+ * lengths are in code units.
+ *
+ * @param src string to convert
+ * @param len length of src in code units
+ * @param dst filled with the converted string
+ * @param dst_len size of dst in code units
+ * @return length of the converted string in code units
+ */
+size_t ucdn_uppercase_utf16(const uint16_t *src, size_t len,
+                            uint16_t *dst, size_t dst_len);
+
+/**
+ * Convert a UTF-8 string to uppercase. Works like ucdn_uppercase(),
+ * lengths are in bytes.
+ *
+ * @param src string to convert
+ * @param len length of src in bytes
+ * @param dst filled with the converted string
+ * @param dst_len size of dst in bytes
+ * @return length of the converted string in bytes
+ */
+size_t ucdn_uppercase_utf8(const uint8_t *src, size_t len,
+                           uint8_t *dst, size_t dst_len);
+
+#define UCDN_CASEFOLD_FULL 0
+#define UCDN_CASEFOLD_SIMPLE 1
+#define UCDN_CASEFOLD_NFKC 2
+
+/* initial value for ucdn_casefold_hash(), the FNV-1a offset basis */
+#define UCDN_CASEFOLD_HASH_INIT 2166136261u
+
+/**
+ * Get the simple case folding of a codepoint (status C and S in
+ * CaseFolding.txt).
+ *
+ * @param code Unicode codepoint
+ * @return folded codepoint, or code if it does not fold
+ */
+uint32_t ucdn_fold_case(uint32_t code);
+
+/**
+ * Full case folding of a codepoint (status C and F in CaseFolding.txt),
+ * e.g. U+00DF to "ss". The Turkic foldings (status T) are not applied.
+ *
+ * @param code Unicode codepoint
+ * @param mapped filled with the folding, must be able to hold 3
+ * characters
+ * @return length of the folding
+ */
+int ucdn_fold_case_full(uint32_t code, uint32_t *mapped);
+
+/**
+ * Get the NFKC_Casefold mapping of a codepoint, which combines
+ * compatibility decomposition, full case folding and the removal of
+ * default ignorable codepoints.
+ *
+ * @param code Unicode codepoint
+ * @param mapped filled with the mapping, must be able to hold 18
+ * characters
+ * @return length of the mapping, 0 for default ignorable codepoints
+ */
+int ucdn_nfkc_casefold(uint32_t code, uint32_t *mapped);
+
+/**
+ * Case fold a UTF-32 string for caseless matching. With
+ * UCDN_CASEFOLD_FULL or UCDN_CASEFOLD_SIMPLE, each codepoint is replaced
+ * with its full or simple case folding. UCDN_CASEFOLD_NFKC replaces each
+ * codepoint with its NFKC_Casefold mapping and normalizes the result to
+ * NFC, which fails like ucdn_normalize() on input that is not in
+ * Stream-Safe Text Format. Output is written like with
+ * ucdn_normalize().
+ *
+ * @param folding UCDN_CASEFOLD_FULL, UCDN_CASEFOLD_SIMPLE or
+ * UCDN_CASEFOLD_NFKC
+ * @param src string to fold
+ * @param len length of src in codepoints
+ * @param dst filled with the folded string
+ * @param dst_len size of dst in codepoints
+ * @return length of the folded string in codepoints, or
+ * UCDN_NORMALIZE_ERROR on error
+ */
+size_t ucdn_casefold(int folding, const uint32_t *src, size_t len,
+                     uint32_t *dst, size_t dst_len);
+
+/**
+ * Case fold a UTF-16 string. Works like ucdn_casefold(), lengths are in
+ * code units. Unpaired surrogates are replaced with U+FFFD.
+ *
+ * @param folding UCDN_CASEFOLD_FULL, UCDN_CASEFOLD_SIMPLE or
+ * UCDN_CASEFOLD_NFKC
+ * @param src string to fold
+ * @param len length of src in code units
+ * @param dst filled with the folded string
+ * @param dst_len size of dst in code units
+ * @return length of the folded string in code units, or
+ * UCDN_NORMALIZE_ERROR on error
+ */
+size_t ucdn_casefold_utf16(int folding, const uint16_t *src, size_t len,
+                           uint16_t *dst, size_t dst_len);
+
+/**
+ * Case fold a UTF-8 string. Works like ucdn_casefold(), lengths are in
+ * bytes. Ill-formed sequences are replaced with U+FFFD.
+ *
+ * @param folding UCDN_CASEFOLD_FULL, UCDN_CASEFOLD_SIMPLE or
+ * UCDN_CASEFOLD_NFKC
+ * @param src string to fold
+ * @param len length of src in bytes
+ * @param dst filled with the folded string
+ * @param dst_len size of dst in bytes
+ * @return length of the folded string in bytes, or UCDN_NORMALIZE_ERROR
+ * on error
+ */
+size_t ucdn_casefold_utf8(int folding, const uint8_t *src, size_t len,
+                          uint8_t *dst, size_t dst_len);
+
+/**
+ * Hash the case folding of a UTF-32 string without storing it. The hash
+ * is 32-bit FNV-1a over the UTF-8 encoding of the string that
+ * ucdn_casefold() would return, so it does not depend on the encoding of
+ * the input. Start with UCDN_CASEFOLD_HASH_INIT and pass the result on
+ * to hash text in chunks, which must be split between codepoints, and
+ * for UCDN_CASEFOLD_NFKC also before a starter that does not combine
+ * with the text before it.
+ *
+ * @param folding UCDN_CASEFOLD_FULL, UCDN_CASEFOLD_SIMPLE or
+ * UCDN_CASEFOLD_NFKC
+ * @param src string to hash
+ * @param len length of src in codepoints
+ * @param hash hash of the text before src, or UCDN_CASEFOLD_HASH_INIT
+ * @return hash of the folded text
+ */
+uint32_t ucdn_casefold_hash(int folding, const uint32_t *src, size_t len,
+                            uint32_t hash);
+
+/**
+ * Hash the case folding of a UTF-16 string. Works like
+ * ucdn_casefold_hash(), the length is in code units.
+ *
+ * @param folding UCDN_CASEFOLD_FULL, UCDN_CASEFOLD_SIMPLE or
+ * UCDN_CASEFOLD_NFKC
+ * @param src string to hash
+ * @param len length of src in code units
+ * @param hash hash of the text before src, or UCDN_CASEFOLD_HASH_INIT
+ * @return hash of the folded text
+ */
+uint32_t ucdn_casefold_hash_utf16(int folding, const uint16_t *src,
+                                  size_t len, uint32_t hash);
+
+/**
+ * Hash the case folding of a UTF-8 string. Works like
+ * ucdn_casefold_hash(), the length is in bytes.
+ *
+ * @param folding UCDN_CASEFOLD_FULL, UCDN_CASEFOLD_SIMPLE or
+ * UCDN_CASEFOLD_NFKC
+ * @param src string to hash
+ * @param len length of src in bytes
+ * @param hash hash of the text before src, or UCDN_CASEFOLD_HASH_INIT
+ * @return hash of the folded text
+ */
+uint32_t ucdn_casefold_hash_utf8(int folding, const uint8_t *src, size_t len,
+                                 uint32_t hash);
+
+#define UCDN_LINEBREAK_NONE 0
+#define UCDN_LINEBREAK_ALLOWED 1
+#define UCDN_LINEBREAK_MANDATORY 2
+
+/**
+ * Find the line break opportunities of a paragraph with the line
+ * breaking algorithm of UAX#14 revision 43, which goes with the Unicode
+ * 12.0.0 database. Classes are resolved as in rule LB1 of
+ * UAX#14, numbers are tailored as in example 7 of section 8.2, as in
+ * LineBreakTest.txt. The break after the last codepoint is always
+ * mandatory (rule LB3).
+ *
+ * @param src paragraph to break
+ * @param breaks filled with the break after each codepoint, according
+ * to UCDN_LINEBREAK_NONE, UCDN_LINEBREAK_ALLOWED and
+ * UCDN_LINEBREAK_MANDATORY
+ * @param len length of src in codepoints
+ */
+void ucdn_linebreaks(const uint32_t *src, uint8_t *breaks, size_t len);
+
+/**
+ * Update the line break opportunities of a paragraph after an edit,
+ * without going over the whole paragraph. The breaks of the text before
+ * the edit must be passed in, with the entries of removed codepoints
+ * taken out and entries for inserted codepoints added, so that they
+ * line up with src. Breaking resumes shortly before the edit and stops
+ * as soon as the breaks after the edit agree with the old ones, so the
+ * cost depends on the size of the edit, not of the paragraph.
+ *
+ * @param src paragraph after the edit
+ * @param breaks breaks from ucdn_linebreaks() before the edit, updated
+ * @param len length of src in codepoints
+ * @param start position of the first inserted codepoint, or of the
+ * first codepoint after removed ones
+ * @param end position after the last inserted codepoint, start if
+ * codepoints were only removed
+ * @return position of the first break that was kept, all breaks from
+ * there on are unchanged
+ */
+size_t ucdn_linebreaks_update(const uint32_t *src, uint8_t *breaks,
+                              size_t len, size_t start, size_t end);
+
+#define UCDN_GRAPHEME_BREAK_OTHER 0
+#define UCDN_GRAPHEME_BREAK_CR 1
+#define UCDN_GRAPHEME_BREAK_LF 2
+#define UCDN_GRAPHEME_BREAK_CONTROL 3
+#define UCDN_GRAPHEME_BREAK_EXTEND 4
+#define UCDN_GRAPHEME_BREAK_ZWJ 5
+#define UCDN_GRAPHEME_BREAK_REGIONAL_INDICATOR 6
+#define UCDN_GRAPHEME_BREAK_PREPEND 7
+#define UCDN_GRAPHEME_BREAK_SPACINGMARK 8
+#define UCDN_GRAPHEME_BREAK_L 9
+#define UCDN_GRAPHEME_BREAK_V 10
+#define UCDN_GRAPHEME_BREAK_T 11
+#define UCDN_GRAPHEME_BREAK_LV 12
+#define UCDN_GRAPHEME_BREAK_LVT 13
+
+/**
+ * Get the Grapheme_Cluster_Break property of a codepoint.
+ *
+ * @param code Unicode codepoint
+ * @return value according to UCDN_GRAPHEME_BREAK_* and as defined in
+ * UAX#29.
+ */
+int ucdn_get_grapheme_break(uint32_t code);
+
+/**
+ * Check if a codepoint has the Extended_Pictographic property of UTS#51.
+ *
+ * @param code Unicode codepoint
+ * @return 1 if the codepoint is Extended_Pictographic, otherwise 0
+ */
+int ucdn_get_extended_pictographic(uint32_t code);
+
+/**
+ * Find the end of an extended grapheme cluster, as defined in UAX#29 and
+ * tested in GraphemeBreakTest.txt. Starting at 0 and passing the result
+ * back in iterates over the clusters of a string.
+ *
+ * @param src string to segment
+ * @param len length of src in codepoints
+ * @param pos start of a cluster
+ * @return start of the next cluster, or len
+ */
+size_t ucdn_next_grapheme(const uint32_t *src, size_t len, size_t pos);
+
+/**
+ * Find the end of an extended grapheme cluster in a UTF-16 string. Works
+ * like ucdn_next_grapheme(), positions are in code units. Unpaired
+ * surrogates are treated as U+FFFD.
+ *
+ * @param src string to segment
+ * @param len length of src in code units
+ * @param pos start of a cluster
+ * @return start of the next cluster, or len
+ */
+size_t ucdn_next_grapheme_utf16(const uint16_t *src, size_t len, size_t pos);
+
+/**
+ * Find the end of an extended grapheme cluster in a UTF-8 string. Works
+ * like ucdn_next_grapheme(), positions are in bytes. Ill-formed
+ * sequences are treated as U+FFFD.
+ *
+ * @param src string to segment
+ * @param len length of src in bytes
+ * @param pos start of a cluster
+ * @return start of the next cluster, or len
+ */
+size_t ucdn_next_grapheme_utf8(const uint8_t *src, size_t len, size_t pos);
+
+/**
+ * Count the extended grapheme clusters of a string, that is, the
+ * user-perceived characters. Runs of ASCII are counted without any table
+ * lookups.
+ *
+ * @param src string to count
+ * @param len length of src in codepoints
+ * @return number of clusters
+ */
+size_t ucdn_count_graphemes(const uint32_t *src, size_t len);
+
+/**
+ * Count the extended grapheme clusters of a UTF-16 string. Works like
+ * ucdn_count_graphemes().
+ *
+ * @param src string to count
+ * @param len length of src in code units
+ * @return number of clusters
+ */
+size_t ucdn_count_graphemes_utf16(const uint16_t *src, size_t len);
+
+/**
+ * Count the extended grapheme clusters of a UTF-8 string. Works like
+ * ucdn_count_graphemes().
+ *
+ * @param src string to count
+ * @param len length of src in bytes
+ * @return number of clusters
+ */
+size_t ucdn_count_graphemes_utf8(const uint8_t *src, size_t len);
+
+#define UCDN_WORD_BREAK_OTHER 0
+#define UCDN_WORD_BREAK_CR 1
+#define UCDN_WORD_BREAK_LF 2
+#define UCDN_WORD_BREAK_NEWLINE 3
+#define UCDN_WORD_BREAK_EXTEND 4
+#define UCDN_WORD_BREAK_ZWJ 5
+#define UCDN_WORD_BREAK_REGIONAL_INDICATOR 6
+#define UCDN_WORD_BREAK_FORMAT 7
+#define UCDN_WORD_BREAK_KATAKANA 8
+#define UCDN_WORD_BREAK_HEBREW_LETTER 9
+#define UCDN_WORD_BREAK_ALETTER 10
+#define UCDN_WORD_BREAK_SINGLE_QUOTE 11
+#define UCDN_WORD_BREAK_DOUBLE_QUOTE 12
+#define UCDN_WORD_BREAK_MIDNUMLET 13
+#define UCDN_WORD_BREAK_MIDLETTER 14
+#define UCDN_WORD_BREAK_MIDNUM 15
+#define UCDN_WORD_BREAK_NUMERIC 16
+#define UCDN_WORD_BREAK_EXTENDNUMLET 17
+#define UCDN_WORD_BREAK_WSEGSPACE 18
+
+#define UCDN_SENTENCE_BREAK_OTHER 0
+#define UCDN_SENTENCE_BREAK_CR 1
+#define UCDN_SENTENCE_BREAK_LF 2
+#define UCDN_SENTENCE_BREAK_EXTEND 3
+#define UCDN_SENTENCE_BREAK_SEP 4
+#define UCDN_SENTENCE_BREAK_FORMAT 5
+#define UCDN_SENTENCE_BREAK_SP 6
+#define UCDN_SENTENCE_BREAK_LOWER 7
+#define UCDN_SENTENCE_BREAK_UPPER 8
+#define UCDN_SENTENCE_BREAK_OLETTER 9
+#define UCDN_SENTENCE_BREAK_NUMERIC 10
+#define UCDN_SENTENCE_BREAK_ATERM 11
+#define UCDN_SENTENCE_BREAK_SCONTINUE 12
+#define UCDN_SENTENCE_BREAK_STERM 13
+#define UCDN_SENTENCE_BREAK_CLOSE 14
+
+/**
+ * Get the Word_Break property of a codepoint.
+ *
+ * @param code Unicode codepoint
+ * @return value according to UCDN_WORD_BREAK_* and as defined in UAX#29.
+ */
+int ucdn_get_word_break(uint32_t code);
+
+/**
+ * Get the Sentence_Break property of a codepoint.
+ *
+ * @param code Unicode codepoint
+ * @return value according to UCDN_SENTENCE_BREAK_* and as defined in
+ * UAX#29.
+ */
+int ucdn_get_sentence_break(uint32_t code);
+
+#define UCDN_SEGMENT_WORD 0
+#define UCDN_SEGMENT_SENTENCE 1
+
+/**
+ * State of a word or sentence segmenter, for finding the boundaries in a
+ * stream of text in chunks. The members are private, use the
+ * ucdn_segmenter_* functions.
+ */
+typedef struct {
+    int type;
+    int encoding;
+    int last;
+    int prev;
+    int term;
+    int state;
+    int ri;
+    unsigned long wait;
+    int pending;
+    size_t pending_pos;
+    size_t offset;
+    uint32_t partial[3];
+    int partial_len;
+} UCDNSegmenter;
+
+/**
+ * Initialize a segmenter for a stream of text.
+ *
+ * The text is passed in chunks of any size with ucdn_segmenter_put(),
+ * which reports the boundaries as offsets from the start of the stream.
+ * A boundary that depends on text after it, like the one before the
+ * full stop in "e.g", is reported once that text has been seen. At most
+ * one boundary is undecided at any time, so segmenting takes constant
+ * memory and linear time whatever the input. The start of the stream is
+ * not reported as a boundary, the end is reported by
+ * ucdn_segmenter_finish(). All calls for a stream must use the same
+ * encoding.
+ *
+ * @param s segmenter to initialize
+ * @param type UCDN_SEGMENT_WORD for word boundaries or
+ * UCDN_SEGMENT_SENTENCE for sentence boundaries, as defined in UAX#29
+ * @return 1 on success, 0 if the type is invalid
+ */
+int ucdn_segmenter_init(UCDNSegmenter *s, int type);
+
+/**
+ * Find the boundaries in a chunk of a UTF-32 stream.
+ *
+ * @param s segmenter
+ * @param src chunk of the stream
+ * @param len length of src in codepoints
+ * @param boundaries filled with the offsets of the boundaries that were
+ * decided, in increasing order, must have room for len + 2 entries
+ * @return number of boundaries written
+ */
+size_t ucdn_segmenter_put(UCDNSegmenter *s, const uint32_t *src, size_t len,
+                          size_t *boundaries);
+
+/**
+ * Find the boundaries in a chunk of a UTF-16 stream. Works like
+ * ucdn_segmenter_put(), offsets are in code units. A surrogate pair may
+ * be split between chunks, unpaired surrogates are treated as U+FFFD.
+ *
+ * @param s segmenter
+ * @param src chunk of the stream
+ * @param len length of src in code units
+ * @param boundaries filled with the offsets of the boundaries that were
+ * decided, must have room for len + 2 entries
+ * @return number of boundaries written
+ */
+size_t ucdn_segmenter_put_utf16(UCDNSegmenter *s, const uint16_t *src,
+                                size_t len, size_t *boundaries);
+
+/**
+ * Find the boundaries in a chunk of a UTF-8 stream. Works like
+ * ucdn_segmenter_put(), offsets are in bytes. A multi-byte sequence may
+ * be split between chunks, ill-formed sequences are treated as U+FFFD.
+ *
+ * @param s segmenter
+ * @param src chunk of the stream
+ * @param len length of src in bytes
+ * @param boundaries filled with the offsets of the boundaries that were
+ * decided, must have room for len + 2 entries
+ * @return number of boundaries written
+ */
+size_t ucdn_segmenter_put_utf8(UCDNSegmenter *s, const uint8_t *src,
+                               size_t len, size_t *boundaries);
+
+/**
+ * End a stream and report the remaining boundaries, including the end of
+ * the stream unless it is empty. The segmenter can then be used for a
+ * new stream.
+ *
+ * @param s segmenter
+ * @param boundaries filled with the offsets of the remaining boundaries,
+ * must have room for 3 entries
+ * @return number of boundaries written
+ */
+size_t ucdn_segmenter_finish(UCDNSegmenter *s, size_t *boundaries);
+
+#define UCDN_BIDI_DIRECTION_LTR 0
+#define UCDN_BIDI_DIRECTION_RTL 1
+#define UCDN_BIDI_DIRECTION_AUTO 2
+
+/**
+ * Number of size_t entries of scratch needed by ucdn_bidi_resolve() for
+ * a paragraph of len codepoints.
+ */
+#define UCDN_BIDI_SCRATCH_LEN(len) \
+    ((len) + ((len) + sizeof(size_t) - 1) / sizeof(size_t))
+
+/**
+ * Resolve the embedding levels of a paragraph with the Unicode
+ * Bidirectional Algorithm (UAX#9), rules P2 to I2, and L1 with the whole
+ * paragraph as one line. Characters removed by rule X9 get the level of
+ * the character before them. Paragraphs without right-to-left or
+ * explicit formatting characters are detected with a single pass over
+ * the bidi classes. No memory is allocated.
+ *
+ * @param direction UCDN_BIDI_DIRECTION_LTR or UCDN_BIDI_DIRECTION_RTL for
+ * the paragraph direction, or UCDN_BIDI_DIRECTION_AUTO to use the first
+ * strong character (rules P2 and P3)
+ * @param src paragraph of Unicode codepoints, a paragraph separator may
+ * only be the last codepoint
+ * @param len number of codepoints
+ * @param levels filled with the embedding level of each codepoint
+ * @param scratch room for UCDN_BIDI_SCRATCH_LEN(len) entries
+ * @return paragraph embedding level, or -1 if direction is invalid
+ */
+int ucdn_bidi_resolve(int direction, const uint32_t *src, size_t len,
+                      uint8_t *levels, size_t *scratch);
+
+/**
+ * Reset the levels of the whitespace at the end of a line to the
+ * paragraph embedding level (the last part of rule L1). This is only
+ * needed when a paragraph is broken into several lines.
+ *
+ * @param line codepoints of the line
+ * @param levels levels of the line, as resolved by ucdn_bidi_resolve()
+ * @param len number of codepoints
+ * @param paragraph_level paragraph embedding level
+ */
+void ucdn_bidi_line_levels(const uint32_t *line, uint8_t *levels, size_t len,
+                           int paragraph_level);
+
+/**
+ * Get the visual order of a line from its embedding levels (rule L2).
+ * Mirrored glyphs (rule L4) can be found with ucdn_mirror().
+ *
+ * @param levels embedding levels of the line
+ * @param len number of codepoints
+ * @param order filled with the logical index of the codepoint shown at
+ * each visual position, from left to right
+ */
+void ucdn_bidi_reorder(const uint8_t *levels, size_t len, size_t *order);
+
 #ifdef __cplusplus
 }
 #endif